@@ -0,0 +1,283 @@
+#include "city_generator.h"
+
+#include "geo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace benchmark {
+
+    namespace {
+
+        const geo::Coordinates CITY_MIN{ 55.55, 37.35 };
+        const geo::Coordinates CITY_MAX{ 55.95, 37.95 };
+
+        double RoundCoordinate(double degrees) {
+            return std::round(degrees * 1e4) / 1e4;
+        }
+
+        std::string StopName(size_t index) {
+            return "Stop " + std::to_string(index);
+        }
+
+        std::string BusName(size_t index) {
+            return std::to_string(index) + "K";
+        }
+
+        json::Dict MakeRenderSettings() {
+            json::Dict settings;
+            settings["width"] = 1200.0;
+            settings["height"] = 1200.0;
+            settings["padding"] = 50.0;
+            settings["line_width"] = 14.0;
+            settings["stop_radius"] = 5.0;
+            settings["bus_label_font_size"] = 20;
+            settings["bus_label_offset"] = json::Array{ 7.0, 15.0 };
+            settings["stop_label_font_size"] = 20;
+            settings["stop_label_offset"] = json::Array{ 7.0, -3.0 };
+            settings["underlayer_color"] = json::Array{ 255, 255, 255, 0.85 };
+            settings["underlayer_width"] = 3.0;
+            settings["color_palette"] = json::Array{ "green", json::Array{ 255, 160, 0 }, "red" };
+            return settings;
+        }
+
+        json::Dict MakeRoutingSettings() {
+            json::Dict settings;
+            settings["bus_wait_time"] = 6;
+            settings["bus_velocity"] = 40.0;
+            return settings;
+        }
+
+        class CityBuilder {
+        public:
+            explicit CityBuilder(const CityParams& params)
+                : params_(params)
+                , random_(params.seed) {
+            }
+
+            json::Document Build() {
+                PlaceStops();
+                for (size_t bus = 0; bus < params_.bus_count && !coords_.empty(); ++bus) {
+                    AddBus(bus);
+                }
+
+                json::Array base_requests;
+                for (size_t stop = 0; stop < coords_.size(); ++stop) {
+                    base_requests.push_back(MakeStop(stop));
+                }
+                for (auto& bus : buses_) {
+                    base_requests.push_back(std::move(bus));
+                }
+
+                json::Dict root;
+                root["base_requests"] = std::move(base_requests);
+                root["render_settings"] = MakeRenderSettings();
+                root["routing_settings"] = MakeRoutingSettings();
+                root["stat_requests"] = MakeStatRequests();
+                return json::Document{ std::move(root) };
+            }
+
+        private:
+            void PlaceStops() {
+                columns_ = std::max<size_t>(static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(params_.stop_count)))), 1);
+                const size_t rows = (params_.stop_count + columns_ - 1) / columns_;
+                const double lat_step = (CITY_MAX.latitude - CITY_MIN.latitude) / std::max<size_t>(rows, 1);
+                const double lon_step = (CITY_MAX.longitude - CITY_MIN.longitude) / columns_;
+
+                for (size_t i = 0; i < params_.stop_count; ++i) {
+                    const size_t row = i / columns_;
+                    const size_t column = i % columns_;
+                    coords_.push_back({
+                        RoundCoordinate(CITY_MIN.latitude + (row + random_.Uniform(0.2, 0.8)) * lat_step),
+                        RoundCoordinate(CITY_MIN.longitude + (column + random_.Uniform(0.2, 0.8)) * lon_step) });
+                }
+            }
+
+            // A random grid neighbour of the stop, the previous stop avoided when possible
+            size_t NextStop(size_t stop, size_t previous) {
+                std::vector<size_t> neighbours;
+                const long long row = static_cast<long long>(stop / columns_);
+                const long long column = static_cast<long long>(stop % columns_);
+                for (long long d_row = -1; d_row <= 1; ++d_row) {
+                    for (long long d_column = -1; d_column <= 1; ++d_column) {
+                        const long long next_row = row + d_row;
+                        const long long next_column = column + d_column;
+                        if ((d_row == 0 && d_column == 0) || next_row < 0 || next_column < 0
+                            || next_column >= static_cast<long long>(columns_)) {
+                            continue;
+                        }
+                        const size_t next = static_cast<size_t>(next_row) * columns_ + static_cast<size_t>(next_column);
+                        if (next < coords_.size() && next != previous) {
+                            neighbours.push_back(next);
+                        }
+                    }
+                }
+                if (neighbours.empty()) {
+                    return previous;
+                }
+                return neighbours[random_.Index(neighbours.size())];
+            }
+
+            void AddBus(size_t bus) {
+                const bool is_roundtrip = random_.Uniform(0.0, 1.0) < params_.roundtrip_ratio;
+                const size_t length = std::max<size_t>(params_.route_length, 2);
+                const size_t walk_length = is_roundtrip ? length - 1 : length;
+
+                std::vector<size_t> route{ random_.Index(coords_.size()) };
+                size_t previous = route.front();
+                while (route.size() < walk_length) {
+                    const size_t next = NextStop(route.back(), previous);
+                    previous = route.back();
+                    route.push_back(next);
+                }
+                if (is_roundtrip) {
+                    route.push_back(route.front());
+                }
+
+                json::Array stops;
+                for (size_t i = 0; i < route.size(); ++i) {
+                    stops.push_back(StopName(route[i]));
+                    if (i > 0) {
+                        AddRoadDistance(route[i - 1], route[i]);
+                    }
+                }
+
+                json::Dict request;
+                request["type"] = "Bus";
+                request["name"] = BusName(bus);
+                request["stops"] = std::move(stops);
+                request["is_roundtrip"] = is_roundtrip;
+                buses_.push_back(std::move(request));
+            }
+
+            // Roads are 10% to 50% longer than the straight line; one direction is enough
+            // as the catalogue falls back to the opposite one
+            void AddRoadDistance(size_t from, size_t to) {
+                if (road_distances_.count({ from, to }) || road_distances_.count({ to, from })) {
+                    return;
+                }
+                const double straight = geo::ComputeDistance(coords_[from], coords_[to]);
+                road_distances_[{ from, to }] = static_cast<int>(std::ceil(straight * random_.Uniform(1.1, 1.5))) + 1;
+            }
+
+            json::Dict MakeStop(size_t stop) {
+                json::Dict road_distances;
+                for (auto it = road_distances_.lower_bound({ stop, 0 }); it != road_distances_.end() && it->first.first == stop; ++it) {
+                    road_distances[StopName(it->first.second)] = it->second;
+                }
+
+                json::Dict request;
+                request["type"] = "Stop";
+                request["name"] = StopName(stop);
+                request["latitude"] = coords_[stop].latitude;
+                request["longitude"] = coords_[stop].longitude;
+                request["road_distances"] = std::move(road_distances);
+                return request;
+            }
+
+            json::Array MakeStatRequests() {
+                const RequestMix& mix = params_.mix;
+                const double weights[] = { mix.stop, mix.bus, mix.route, mix.map, mix.nearby };
+                double total_weight = 0.0;
+                for (const double weight : weights) {
+                    total_weight += std::max(weight, 0.0);
+                }
+
+                json::Array requests;
+                for (size_t id = 1; id <= params_.request_count && total_weight > 0.0 && !coords_.empty(); ++id) {
+                    double choice = random_.Uniform(0.0, total_weight);
+                    size_t type = 0;
+                    while (type + 1 < std::size(weights) && choice >= std::max(weights[type], 0.0)) {
+                        choice -= std::max(weights[type], 0.0);
+                        ++type;
+                    }
+
+                    json::Dict request;
+                    request["id"] = static_cast<int>(id);
+                    switch (type) {
+                    case 0:
+                        request["type"] = "Stop";
+                        request["name"] = StopName(random_.Index(coords_.size()));
+                        break;
+                    case 1:
+                        request["type"] = "Bus";
+                        request["name"] = BusName(random_.Index(std::max<size_t>(params_.bus_count, 1)));
+                        break;
+                    case 2:
+                        request["type"] = "Route";
+                        request["from"] = StopName(random_.Index(coords_.size()));
+                        request["to"] = StopName(random_.Index(coords_.size()));
+                        break;
+                    case 3:
+                        request["type"] = "Map";
+                        break;
+                    default:
+                        request["type"] = "Nearby";
+                        request["latitude"] = RoundCoordinate(random_.Uniform(CITY_MIN.latitude, CITY_MAX.latitude));
+                        request["longitude"] = RoundCoordinate(random_.Uniform(CITY_MIN.longitude, CITY_MAX.longitude));
+                        request["count"] = 5;
+                        break;
+                    }
+                    requests.push_back(std::move(request));
+                }
+                return requests;
+            }
+
+            const CityParams& params_;
+            Random random_;
+            size_t columns_ = 1;
+            std::vector<geo::Coordinates> coords_;
+            std::map<std::pair<size_t, size_t>, int> road_distances_;
+            json::Array buses_;
+        };
+
+    } // namespace
+
+    json::Document GenerateCity(const CityParams& params) {
+        return CityBuilder(params).Build();
+    }
+
+    bool ParseCityOption(std::string_view option, const std::string& value, CityParams& params) {
+        using namespace std::literals;
+
+        if (option == "--stops"sv) {
+            params.stop_count = std::stoul(value);
+        }
+        else if (option == "--buses"sv) {
+            params.bus_count = std::stoul(value);
+        }
+        else if (option == "--route-length"sv) {
+            params.route_length = std::stoul(value);
+        }
+        else if (option == "--roundtrip-ratio"sv) {
+            params.roundtrip_ratio = std::stod(value);
+        }
+        else if (option == "--requests"sv) {
+            params.request_count = std::stoul(value);
+        }
+        else if (option == "--seed"sv) {
+            params.seed = std::stoull(value);
+        }
+        else if (option == "--mix"sv) {
+            double* weights[] = { &params.mix.stop, &params.mix.bus, &params.mix.route, &params.mix.map, &params.mix.nearby };
+            size_t start = 0;
+            for (double* weight : weights) {
+                if (start > value.size()) {
+                    break;
+                }
+                const size_t end = std::min(value.find(',', start), value.size());
+                *weight = std::stod(value.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+} // namespace benchmark
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace benchmark {
+
+    // Relative weights of stat request types
+    struct RequestMix {
+        double stop = 0.3;
+        double bus = 0.3;
+        double route = 0.3;
+        double map = 0.01;
+        double nearby = 0.09;
+    };
+
+    struct CityParams {
+        size_t stop_count = 1000;
+        size_t bus_count = 100;
+        // Stops per bus, the closing stop of a roundtrip included
+        size_t route_length = 20;
+        double roundtrip_ratio = 0.5;
+        size_t request_count = 1000;
+        RequestMix mix;
+        std::uint64_t seed = 1;
+    };
+
+    // Only raw std::mt19937_64 output is used, never std distributions,
+    // so a seed gives the same numbers with every standard library
+    class Random {
+    public:
+        explicit Random(std::uint64_t seed)
+            : engine_(seed) {
+        }
+
+        double Uniform(double min, double max) {
+            return min + (max - min) * static_cast<double>(engine_() >> 11) * 0x1.0p-53;
+        }
+
+        size_t Index(size_t size) {
+            return static_cast<size_t>(engine_() % size);
+        }
+
+    private:
+        std::mt19937_64 engine_;
+    };
+
+    // Stops on a jittered grid, buses walking between neighbouring stops, road distances
+    // longer than straight lines, then a request batch of the given mix. Coordinates are
+    // rounded so that printing and loading the document gives back the same catalogue
+    json::Document GenerateCity(const CityParams& params);
+
+    // Applies a --stops, --buses, --route-length, --roundtrip-ratio, --requests, --seed or
+    // --mix STOP,BUS,ROUTE,MAP,NEARBY option; false if the option is not one of these
+    bool ParseCityOption(std::string_view option, const std::string& value, CityParams& params);
+
+} // namespace benchmark
\ No newline at end of file
@@ -0,0 +1,188 @@
+// End-to-end timings of transport_catalogue phases on generated cities, one JSON line per
+// phase and city size, e.g.
+//   e2e_benchmark --sizes 1000,10000 --memory-budget 1024 --runs 5 --requests 10000 --threads 4
+// --memory-budget MB plans the router as main does, so large cities get a search per query
+// instead of an all-pairs table that would not fit. Every other option is passed to the city
+// generator, see ParseCityOption. The same seed
+// gives the same cities on every machine, so results of different builds are comparable.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue e2e_benchmark.cpp city_generator.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "city_generator.h"
+#include "timing.h"
+
+#include "json.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    struct Options {
+        benchmark::CityParams city;
+        std::vector<size_t> sizes;
+        size_t runs = 5;
+        size_t thread_count = 1;
+        std::optional<size_t> memory_budget;
+    };
+
+    std::vector<size_t> ParseSizes(const std::string& value) {
+        std::vector<size_t> sizes;
+        size_t start = 0;
+        while (start < value.size()) {
+            const size_t end = std::min(value.find(',', start), value.size());
+            sizes.push_back(std::stoul(value.substr(start, end - start)));
+            start = end + 1;
+        }
+        return sizes;
+    }
+
+    // The catalogue keeps views of names in the document, so both live together
+    struct LoadedCity {
+        std::unique_ptr<json::Document> doc;
+        std::unique_ptr<transport::TransportCatalogue> catalogue;
+
+        const json::Dict& Root() const {
+            return doc->GetRoot().AsMap();
+        }
+    };
+
+    const char* ToString(transport::RoutingStrategy strategy) {
+        return strategy == transport::RoutingStrategy::DIJKSTRA ? "dijkstra" : "all_pairs";
+    }
+
+    // Planned for the route requests of the city, as main does
+    transport::Router ParseRoutingSettings(const Options& options, const LoadedCity& city) {
+        transport::Router settings = json_reader::ParseRouterSettings(city.Root().at("routing_settings").AsMap());
+        settings.SetRouteQueryCount(request_handler::CountRouteRequests(
+            json_reader::ParseStatRequests(*city.catalogue, city.Root().at("stat_requests").AsArray())));
+        if (options.memory_budget) {
+            settings.SetMemoryBudget(*options.memory_budget);
+        }
+        return settings;
+    }
+
+    LoadedCity LoadCity(const std::string& text) {
+        std::istringstream input(text);
+        LoadedCity city{ std::make_unique<json::Document>(json::Load(input)), std::make_unique<transport::TransportCatalogue>() };
+        json_reader::ParseBaseRequests(*city.catalogue, city.Root().at("base_requests").AsArray());
+        return city;
+    }
+
+    void RunScenario(const Options& options, size_t stop_count) {
+        benchmark::CityParams params = options.city;
+        params.stop_count = stop_count;
+        // Keep the share of stops served by buses the same for every size
+        params.bus_count = std::max<size_t>(stop_count * options.city.bus_count / std::max<size_t>(options.city.stop_count, 1), 1);
+        const std::string scenario = "stops=" + std::to_string(params.stop_count) + " buses=" + std::to_string(params.bus_count)
+            + " requests=" + std::to_string(params.request_count) + " seed=" + std::to_string(params.seed);
+
+        const json::Document generated = benchmark::GenerateCity(params);
+        std::string text;
+        const auto print = benchmark::Measure(options.runs, [] { return 0; }, [&](int) {
+            std::ostringstream out;
+            json::Print(generated, out);
+            text = out.str();
+        });
+        benchmark::PrintTiming(std::cout, scenario, "json.Print", print);
+
+        const auto load = benchmark::Measure(options.runs, [&] { return std::istringstream(text); }, [](std::istringstream& input) {
+            json::Load(input);
+        });
+        benchmark::PrintTiming(std::cout, scenario, "json.Load", load);
+
+        const auto base = benchmark::Measure(options.runs,
+            [&] {
+                std::istringstream input(text);
+                return std::make_unique<json::Document>(json::Load(input));
+            },
+            [](std::unique_ptr<json::Document>& doc) {
+                transport::TransportCatalogue catalogue;
+                json_reader::ParseBaseRequests(catalogue, doc->GetRoot().AsMap().at("base_requests").AsArray());
+            });
+        benchmark::PrintTiming(std::cout, scenario, "ParseBaseRequests", base);
+
+        const LoadedCity city = LoadCity(text);
+        const auto routing_settings = ParseRoutingSettings(options, city);
+        const auto render_settings = json_reader::ParseRenderSettings(city.Root().at("render_settings").AsMap());
+
+        // The planned strategy is part of the phase name, as timings of different ones do not compare
+        transport::CheckRouterMemory(routing_settings, *city.catalogue);
+        const auto router = benchmark::Measure(options.runs, [] { return 0; }, [&](int) {
+            transport::Router built(routing_settings, *city.catalogue);
+        });
+        benchmark::PrintTiming(std::cout, scenario,
+            std::string("Router.") + ToString(routing_settings.Plan(*city.catalogue).strategy), router);
+
+        const auto render = benchmark::Measure(options.runs, [] { return 0; }, [&](int) {
+            map::MapRenderer(render_settings, *city.catalogue).RenderMap();
+        });
+        benchmark::PrintTiming(std::cout, scenario, "RenderMap", render);
+
+        const auto& stat_array = city.Root().at("stat_requests").AsArray();
+        const auto parse_stats = benchmark::Measure(options.runs, [] { return 0; }, [&](int) {
+            json_reader::ParseStatRequests(*city.catalogue, stat_array);
+        });
+        benchmark::PrintTiming(std::cout, scenario, "ParseStatRequests", parse_stats);
+
+        // Answering alone: the router and the map are built before the clock starts
+        const auto stat_requests = json_reader::ParseStatRequests(*city.catalogue, stat_array);
+        request_handler::RequestHandler handler(*city.catalogue, render_settings,
+            ParseRoutingSettings(options, city));
+        handler.GetRouter();
+        handler.GetMapRenderer().GetMapSvg();
+        const auto answer = benchmark::Measure(options.runs, [] { return 0; }, [&](int) {
+            std::ostringstream out;
+            handler.PrintStatResponses(stat_requests, out, options.thread_count);
+        });
+        benchmark::PrintTiming(std::cout, scenario, "PrintStatResponses", answer);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using namespace std::literals;
+
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (argv[i] == "--sizes"sv) {
+            options.sizes = ParseSizes(argv[i + 1]);
+        }
+        else if (argv[i] == "--runs"sv) {
+            options.runs = std::stoul(argv[i + 1]);
+        }
+        else if (argv[i] == "--threads"sv) {
+            options.thread_count = std::stoul(argv[i + 1]);
+        }
+        else if (argv[i] == "--memory-budget"sv) {
+            options.memory_budget = std::stoull(argv[i + 1]) << 20;
+        }
+        else if (!benchmark::ParseCityOption(argv[i], argv[i + 1], options.city)) {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (options.sizes.empty()) {
+        options.sizes = { options.city.stop_count };
+    }
+
+    try {
+        for (const size_t stop_count : options.sizes) {
+            RunScenario(options, stop_count);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+// Prints a synthetic city document for transport_catalogue, e.g.
+//   generate_city --stops 10000 --buses 800 --route-length 30 --requests 100000 > city.json
+// Build: g++ -std=c++17 -O2 -I../transport-catalogue generate_city.cpp city_generator.cpp
+//   ../transport-catalogue/json.cpp ../transport-catalogue/geo.cpp ../transport-catalogue/instrumentation.cpp
+
+#include "city_generator.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    benchmark::CityParams params;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!benchmark::ParseCityOption(argv[i], argv[i + 1], params)) {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    json::Print(benchmark::GenerateCity(params), std::cout);
+    std::cout << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,240 @@
+// Timings of single hot functions on fixed generated inputs, one JSON line per function
+// with the median and median absolute deviation of the per call time, e.g.
+//   micro_benchmark --filter json --runs 31
+// Inputs depend only on the constants below, so results of different commits are comparable.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue micro_benchmark.cpp city_generator.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "city_generator.h"
+#include "timing.h"
+
+#include "dijkstra_router.h"
+#include "geo.h"
+#include "json.h"
+#include "json_builder.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "router.h"
+#include "svg.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    // Small enough for the all-pairs router to build in a fraction of a second
+    benchmark::CityParams MakeCityParams() {
+        benchmark::CityParams params;
+        params.stop_count = 400;
+        params.bus_count = 40;
+        params.route_length = 20;
+        params.request_count = 1000;
+        params.seed = 1;
+        return params;
+    }
+
+    struct Options {
+        std::string filter;
+        size_t runs = 15;
+        double min_run_ms = 20.0;
+    };
+
+    class Suite {
+    public:
+        explicit Suite(const Options& options)
+            : options_(options) {
+        }
+
+        template <typename Action>
+        void Run(std::string_view name, Action action) {
+            if (name.find(options_.filter) == std::string_view::npos) {
+                return;
+            }
+            benchmark::PrintTiming(std::cout, "micro", name, benchmark::MeasureCalls(options_.runs, options_.min_run_ms, action));
+        }
+
+    private:
+        const Options& options_;
+    };
+
+    // A document of the shapes a map is made of, drawn with the same attributes
+    svg::Document MakeSvgDocument(const transport::TransportCatalogue& catalogue) {
+        const auto stops = catalogue.GetSortedStops();
+        const auto buses = catalogue.GetSortedBuses();
+        std::vector<geo::Coordinates> points;
+        for (const auto& [name, stop] : stops) {
+            points.push_back(stop->coords);
+        }
+        const map::SphereProjector projector(points.begin(), points.end(), 1200.0, 1200.0, 50.0);
+
+        svg::Document doc;
+        for (const auto& [name, bus] : buses) {
+            svg::Polyline line;
+            for (const transport::Stop* stop : bus->stops) {
+                line.AddPoint(projector(stop->coords));
+            }
+            doc.Add(std::move(line.SetStrokeColor("green").SetFillColor(svg::NoneColor).SetStrokeWidth(14.0)
+                .SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)));
+        }
+        for (const auto& [name, stop] : stops) {
+            doc.Add(svg::Circle().SetCenter(projector(stop->coords)).SetRadius(5.0).SetFillColor("white"));
+        }
+        for (const auto& [name, stop] : stops) {
+            doc.Add(svg::Text().SetPosition(projector(stop->coords)).SetOffset({ 7.0, -3.0 }).SetFontSize(20)
+                .SetFontFamily("Verdana").SetData(stop->name).SetFillColor("black"));
+        }
+        return doc;
+    }
+
+    void RunAll(const Options& options) {
+        Suite suite(options);
+
+        const json::Document generated = benchmark::GenerateCity(MakeCityParams());
+        std::ostringstream printed;
+        json::Print(generated, printed);
+        const std::string text = printed.str();
+        std::istringstream input(text);
+        const json::Document doc = json::Load(input);
+        const auto& root = doc.GetRoot().AsMap();
+
+        transport::TransportCatalogue catalogue;
+        json_reader::ParseBaseRequests(catalogue, root.at("base_requests").AsArray());
+        const auto buses = catalogue.GetSortedBuses();
+        const auto stops = catalogue.GetSortedStops();
+        std::vector<const transport::BusRoute*> bus_list;
+        for (const auto& [name, bus] : buses) {
+            bus_list.push_back(bus);
+        }
+        std::vector<std::string_view> stop_names;
+        std::vector<geo::Coordinates> stop_coords;
+        std::vector<geo::UnitVector> stop_vectors;
+        for (const auto& [name, stop] : stops) {
+            stop_names.push_back(name);
+            stop_coords.push_back(stop->coords);
+            stop_vectors.push_back(geo::ToUnitVector(stop->coords));
+        }
+        // Consecutive stops of every bus, each pair has a road distance
+        std::vector<std::pair<const transport::Stop*, const transport::Stop*>> segments;
+        for (const transport::BusRoute* bus : bus_list) {
+            for (size_t i = 0; i + 1 < bus->stops.size(); ++i) {
+                segments.emplace_back(bus->stops[i], bus->stops[i + 1]);
+            }
+        }
+
+        suite.Run("json.Load", [&](size_t) {
+            std::istringstream in(text);
+            benchmark::DoNotOptimize(json::Load(in));
+        });
+        suite.Run("json.Print", [&](size_t) {
+            std::ostringstream out;
+            json::Print(doc, out);
+            benchmark::DoNotOptimize(out);
+        });
+        suite.Run("json.Builder", [&](size_t) {
+            // The shape of Bus responses for every bus
+            json::Builder builder;
+            auto array = builder.StartArray();
+            for (size_t i = 0; i < bus_list.size(); ++i) {
+                array.StartDict()
+                    .Key("curvature").Value(1.25)
+                    .Key("request_id").Value(static_cast<int>(i))
+                    .Key("route_length").Value(12345)
+                    .Key("stop_count").Value(20)
+                    .Key("unique_stop_count").Value(15)
+                    .EndDict();
+            }
+            benchmark::DoNotOptimize(array.EndArray().Build());
+        });
+
+        suite.Run("TransportCatalogue.GetBusInfo", [&](size_t call) {
+            benchmark::DoNotOptimize(catalogue.GetBusInfo(bus_list[call % bus_list.size()]));
+        });
+        suite.Run("TransportCatalogue.GetStopInfo", [&](size_t call) {
+            benchmark::DoNotOptimize(catalogue.GetStopInfo(stop_names[call % stop_names.size()]));
+        });
+        suite.Run("TransportCatalogue.GetDistance", [&](size_t call) {
+            const auto& [from, to] = segments[call % segments.size()];
+            benchmark::DoNotOptimize(catalogue.GetDistance(from, to));
+        });
+        suite.Run("geo.ComputeDistance", [&](size_t call) {
+            const size_t from = call % stop_coords.size();
+            const size_t to = (call * 7 + 1) % stop_coords.size();
+            benchmark::DoNotOptimize(geo::ComputeDistance(stop_coords[from], stop_coords[to]));
+        });
+        // Same pairs through the chord kernel
+        suite.Run("geo.ComputeDistance.UnitVector", [&](size_t call) {
+            const size_t from = call % stop_vectors.size();
+            const size_t to = (call * 7 + 1) % stop_vectors.size();
+            benchmark::DoNotOptimize(geo::ComputeDistance(stop_vectors[from], stop_vectors[to]));
+        });
+
+        const auto& routing_settings = root.at("routing_settings").AsMap();
+        suite.Run("Router.BuildGraph", [&](size_t) {
+            transport::Router router = json_reader::ParseRouterSettings(routing_settings);
+            benchmark::DoNotOptimize(router.BuildGraph(catalogue).GetEdgeCount());
+        });
+        transport::Router graph_owner = json_reader::ParseRouterSettings(routing_settings);
+        const auto& graph = graph_owner.BuildGraph(catalogue);
+        suite.Run("graph.Router", [&](size_t) {
+            graph::Router<double> router(graph);
+            benchmark::DoNotOptimize(router);
+        });
+        const graph::Router<double> router(graph);
+        suite.Run("graph.Router.BuildRoute", [&](size_t call) {
+            const size_t vertex_count = graph.GetVertexCount();
+            benchmark::DoNotOptimize(router.BuildRoute(call % vertex_count, (call * 7 + 3) % vertex_count));
+        });
+        const graph::DijkstraRouter<double> dijkstra_router(graph);
+        suite.Run("graph.DijkstraRouter.BuildRoute", [&](size_t call) {
+            const size_t vertex_count = graph.GetVertexCount();
+            benchmark::DoNotOptimize(dijkstra_router.BuildRoute(call % vertex_count, (call * 7 + 3) % vertex_count));
+        });
+
+        const auto render_settings = json_reader::ParseRenderSettings(root.at("render_settings").AsMap());
+        suite.Run("MapRenderer.RenderMap", [&](size_t) {
+            benchmark::DoNotOptimize(map::MapRenderer(render_settings, catalogue).RenderMap());
+        });
+        const svg::Document svg_doc = MakeSvgDocument(catalogue);
+        suite.Run("svg.Document.Render", [&](size_t) {
+            std::ostringstream out;
+            svg_doc.Render(out);
+            benchmark::DoNotOptimize(out);
+        });
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using namespace std::literals;
+
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (argv[i] == "--filter"sv) {
+            options.filter = argv[i + 1];
+        }
+        else if (argv[i] == "--runs"sv) {
+            options.runs = std::stoul(argv[i + 1]);
+        }
+        else if (argv[i] == "--min-run-ms"sv) {
+            options.min_run_ms = std::stod(argv[i + 1]);
+        }
+        else {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        RunAll(options);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
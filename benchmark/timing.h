@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace benchmark {
+
+    struct Timing {
+        double min_ms = 0.0;
+        double median_ms = 0.0;
+        // Median absolute deviation from the median, robust to the odd slow run
+        double mad_ms = 0.0;
+        size_t runs = 0;
+        // Calls timed together in one run, the times above are per call
+        size_t iterations = 1;
+    };
+
+    // Keeps the compiler from dropping a computation whose result is unused
+    template <typename T>
+    inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    inline double Median(std::vector<double> values) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        const size_t middle = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + middle, values.end());
+        if (values.size() % 2 == 1) {
+            return values[middle];
+        }
+        return (values[middle] + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+    }
+
+    inline Timing Summarize(const std::vector<double>& samples_ms) {
+        Timing timing;
+        timing.runs = samples_ms.size();
+        if (samples_ms.empty()) {
+            return timing;
+        }
+        timing.min_ms = *std::min_element(samples_ms.begin(), samples_ms.end());
+        timing.median_ms = Median(samples_ms);
+        std::vector<double> deviations;
+        deviations.reserve(samples_ms.size());
+        for (const double sample : samples_ms) {
+            deviations.push_back(std::abs(sample - timing.median_ms));
+        }
+        timing.mad_ms = Median(std::move(deviations));
+        return timing;
+    }
+
+    // Calls prepare() untimed and then action(prepared) timed, runs times over
+    template <typename Prepare, typename Action>
+    Timing Measure(size_t runs, Prepare prepare, Action action) {
+        std::vector<double> samples_ms;
+        samples_ms.reserve(runs);
+        for (size_t run = 0; run < runs; ++run) {
+            auto prepared = prepare();
+            const auto start = std::chrono::steady_clock::now();
+            action(prepared);
+            const auto finish = std::chrono::steady_clock::now();
+            samples_ms.push_back(std::chrono::duration<double, std::milli>(finish - start).count());
+        }
+        return Summarize(samples_ms);
+    }
+
+    // Times batches of action(i) calls, the batch made large enough for a run to last
+    // about min_run_ms so that short functions are not lost in clock resolution
+    template <typename Action>
+    Timing MeasureCalls(size_t runs, double min_run_ms, Action action) {
+        using Clock = std::chrono::steady_clock;
+        size_t iterations = 1;
+        size_t call = 0;
+        while (true) {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) {
+                action(call++);
+            }
+            const double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (elapsed_ms >= min_run_ms || iterations >= (size_t(1) << 30)) {
+                break;
+            }
+            iterations *= elapsed_ms * 10 < min_run_ms ? 10 : 2;
+        }
+
+        std::vector<double> samples_ms;
+        samples_ms.reserve(runs);
+        for (size_t run = 0; run < runs; ++run) {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) {
+                action(call++);
+            }
+            samples_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations);
+        }
+        Timing timing = Summarize(samples_ms);
+        timing.iterations = iterations;
+        return timing;
+    }
+
+    // One JSON object per line, names are expected to need no escaping
+    inline void PrintTiming(std::ostream& out, std::string_view scenario, std::string_view phase, const Timing& timing) {
+        out << "{\"scenario\": \"" << scenario << "\", \"phase\": \"" << phase
+            << "\", \"runs\": " << timing.runs
+            << ", \"iterations\": " << timing.iterations
+            << ", \"min_ms\": " << timing.min_ms
+            << ", \"median_ms\": " << timing.median_ms
+            << ", \"mad_ms\": " << timing.mad_ms << "}" << std::endl;
+    }
+
+} // namespace benchmark
\ No newline at end of file
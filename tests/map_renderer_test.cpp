@@ -0,0 +1,78 @@
+// Checks that a viewport map draws the bus segments crossing the viewport, also those
+// with both stops outside it. Exits with 1 on the first failed check.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue map_renderer_test.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            std::exit(1);
+        }
+    }
+
+    size_t CountLines(const std::string& svg) {
+        size_t count = 0;
+        for (size_t pos = svg.find("<polyline"); pos != std::string::npos; pos = svg.find("<polyline", pos + 1)) {
+            ++count;
+        }
+        return count;
+    }
+
+    map::RenderSettings MakeSettings() {
+        map::RenderSettings settings;
+        settings.width = 600.0;
+        settings.height = 400.0;
+        settings.padding = 50.0;
+        settings.line_width = 14.0;
+        settings.stop_radius = 5.0;
+        settings.color_palette = { svg::Color{ std::string("green") } };
+        return settings;
+    }
+
+    // Bus 1 runs from West to East straight through the viewport, bus 2 runs north of it
+    void FillCatalogue(transport::TransportCatalogue& catalogue) {
+        catalogue.AddStop("West", { 55.65, 37.30 });
+        catalogue.AddStop("East", { 55.65, 37.90 });
+        catalogue.AddStop("North West", { 55.90, 37.30 });
+        catalogue.AddStop("North East", { 55.90, 37.90 });
+        catalogue.AddBus("1", { "West", "East" }, false);
+        catalogue.AddBus("2", { "North West", "North East" }, false);
+    }
+
+    void TestSegmentThroughViewport(const transport::TransportCatalogue& catalogue) {
+        for (double tolerance : { 0.0, 2.0 }) {
+            map::RenderSettings settings = MakeSettings();
+            settings.simplify_tolerance = tolerance;
+            const map::MapRenderer renderer(settings, catalogue);
+            const geo::BoundingBox viewport{ { 55.60, 37.55 }, { 55.70, 37.65 } };
+            const std::string svg = renderer.RenderMap(viewport);
+            Check(CountLines(svg) > 0, "a segment with both stops outside the viewport is drawn");
+            Check(svg.find("<circle") == std::string::npos, "stops outside the viewport are not drawn");
+        }
+    }
+
+    void TestSegmentPastViewport(const transport::TransportCatalogue& catalogue) {
+        const map::MapRenderer renderer(MakeSettings(), catalogue);
+        const geo::BoundingBox viewport{ { 55.75, 37.55 }, { 55.80, 37.65 } };
+        Check(CountLines(renderer.RenderMap(viewport)) == 0, "segments passing by the viewport are not drawn");
+    }
+
+} // namespace
+
+int main() {
+    transport::TransportCatalogue catalogue;
+    FillCatalogue(catalogue);
+    TestSegmentThroughViewport(catalogue);
+    TestSegmentPastViewport(catalogue);
+    std::cout << "OK" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+// Checks that stat requests answered on several threads, as with --threads, print the same
+// responses as on one thread and fail the same way. Exits with 1 on the first failed check.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue request_handler_test.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // Stops A, B and C; bus 1 runs A - B with a distance, bus 2 runs B - C without one
+    void FillCatalogue(transport::TransportCatalogue& catalogue) {
+        catalogue.AddStop("A", { 55.60, 37.20 });
+        catalogue.AddStop("B", { 55.61, 37.21 });
+        catalogue.AddStop("C", { 55.62, 37.22 });
+        catalogue.SetRoadDistance(catalogue.GetStopByName("A"), catalogue.GetStopByName("B"), 1500);
+        catalogue.AddBus("1", { "A", "B" }, false);
+        catalogue.AddBus("2", { "B", "C" }, false);
+    }
+
+    // Enough requests for several chunks of answers
+    std::vector<request_handler::StatRequest> MakeRequests(const transport::TransportCatalogue& catalogue, size_t count) {
+        std::vector<request_handler::StatRequest> requests;
+        for (int id = 0; id < static_cast<int>(count); ++id) {
+            if (id % 2 == 0) {
+                requests.push_back(request_handler::StopStatRequest{ id, catalogue.GetStopByName("B") });
+            }
+            else {
+                requests.push_back(request_handler::BusStatRequest{ id, catalogue.GetBusByName("1") });
+            }
+        }
+        return requests;
+    }
+
+    std::string Answer(request_handler::RequestHandler& handler,
+        const std::vector<request_handler::StatRequest>& requests, size_t thread_count) {
+        std::ostringstream out;
+        handler.PrintStatResponses(requests, out, thread_count);
+        return out.str();
+    }
+
+    void TestThreadsPrintSameResponses(const transport::TransportCatalogue& catalogue) {
+        request_handler::RequestHandler handler(catalogue, map::RenderSettings{}, transport::Router(6, 40));
+        const auto requests = MakeRequests(catalogue, 1000);
+        const std::string expected = Answer(handler, requests, 1);
+        Check(Answer(handler, requests, 4) == expected, "4 threads print the responses of 1 thread");
+        Check(Answer(handler, requests, 0) == expected, "a thread per core prints the responses of 1 thread");
+    }
+
+    void TestThreadsRethrowFailure(const transport::TransportCatalogue& catalogue) {
+        request_handler::RequestHandler handler(catalogue, map::RenderSettings{}, transport::Router(6, 40));
+        auto requests = MakeRequests(catalogue, 1000);
+        // Bus 2 has no road distance, so its stats throw
+        requests[700] = request_handler::BusStatRequest{ 700, catalogue.GetBusByName("2") };
+        for (size_t thread_count : { 1, 4 }) {
+            bool thrown = false;
+            try {
+                Answer(handler, requests, thread_count);
+            }
+            catch (const std::out_of_range&) {
+                thrown = true;
+            }
+            Check(thrown, "a failed request throws on " + std::to_string(thread_count) + " threads");
+        }
+    }
+
+} // namespace
+
+int main() {
+    transport::TransportCatalogue catalogue;
+    FillCatalogue(catalogue);
+    TestThreadsPrintSameResponses(catalogue);
+    TestThreadsRethrowFailure(catalogue);
+    std::cout << "OK" << std::endl;
+    return 0;
+}
\ No newline at end of file
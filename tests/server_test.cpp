@@ -0,0 +1,65 @@
+// Checks that a server answering a batch a request of which fails replies with an error
+// and goes on serving the next batches. Exits with 1 on the first failed check.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue server_test.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "server.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // Stops A, B and C; bus 1 runs A - B with a distance, bus 2 runs B - C without one
+    void FillCatalogue(transport::TransportCatalogue& catalogue) {
+        catalogue.AddStop("A", { 55.60, 37.20 });
+        catalogue.AddStop("B", { 55.61, 37.21 });
+        catalogue.AddStop("C", { 55.62, 37.22 });
+        catalogue.SetRoadDistance(catalogue.GetStopByName("A"), catalogue.GetStopByName("B"), 1500);
+        catalogue.AddBus("1", { "A", "B" }, false);
+        catalogue.AddBus("2", { "B", "C" }, false);
+    }
+
+    std::string Serve(const std::string& input, const server::Services& services) {
+        std::istringstream in(input);
+        std::ostringstream out;
+        server::ServeStream(in, out, services);
+        return out.str();
+    }
+
+    void TestServerSurvivesFailedBatch(const server::Services& services) {
+        const std::string good = R"({"stat_requests": [{"id": 1, "type": "Bus", "name": "1"}, {"id": 2, "type": "Stop", "name": "B"}]})";
+        // Bus 2 has no road distance, so its stats throw
+        const std::string bad = R"({"stat_requests": [{"id": 3, "type": "Bus", "name": "2"}]})";
+        const std::string answer = Serve(good, services);
+        Check(answer.find("\"curvature\"") != std::string::npos, "a good batch is answered");
+
+        const std::string answers = Serve(good + "\n" + bad + "\n" + good, services);
+        const size_t error = answers.find("\"error_message\"");
+        Check(answers.compare(0, answer.size(), answer) == 0, "the batch before the failed one is answered");
+        Check(error != std::string::npos && error > answer.size(), "the failed batch gets an error");
+        Check(answers.size() > answer.size() && answers.compare(answers.size() - answer.size(), answer.size(), answer) == 0,
+            "the batch after the failed one is answered");
+    }
+
+} // namespace
+
+int main() {
+    transport::TransportCatalogue catalogue;
+    FillCatalogue(catalogue);
+    request_handler::RequestHandler handler(catalogue, map::RenderSettings{}, transport::Router(6, 40));
+    for (size_t thread_count : { 1, 4 }) {
+        TestServerSurvivesFailedBatch(server::Services{ catalogue, handler, thread_count });
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+// Checks nearest stop queries of the stop index against a scan of all stops, also in a sparse
+// grid where the nearest stops are many cells away. Exits with 1 on the first failed check.
+// Build: g++ -std=c++17 -O2 -pthread -I../transport-catalogue stop_index_test.cpp
+//   $(ls ../transport-catalogue/*.cpp | grep -v main.cpp)
+
+#include "stop_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            std::exit(1);
+        }
+    }
+
+    std::vector<const transport::Stop*> FindNearestByScan(const std::deque<transport::Stop>& stops,
+        geo::Coordinates center, size_t count) {
+        std::vector<transport::NearbyStop> all;
+        for (const transport::Stop& stop : stops) {
+            all.push_back({ &stop, geo::ComputeDistance(center, stop.coords) });
+        }
+        std::sort(all.begin(), all.end(), [](const transport::NearbyStop& lhs, const transport::NearbyStop& rhs) {
+            return lhs.distance != rhs.distance ? lhs.distance < rhs.distance : lhs.stop->name < rhs.stop->name;
+        });
+        std::vector<const transport::Stop*> result;
+        for (size_t i = 0; i < std::min(count, all.size()); ++i) {
+            result.push_back(all[i].stop);
+        }
+        return result;
+    }
+
+    void CheckNearest(const transport::StopIndex& index, const std::deque<transport::Stop>& stops,
+        geo::Coordinates center, size_t count, const std::string& what) {
+        std::vector<const transport::Stop*> found;
+        for (const transport::NearbyStop& nearby : index.FindNearest(center, count)) {
+            found.push_back(nearby.stop);
+        }
+        Check(found == FindNearestByScan(stops, center, count), what);
+    }
+
+    void AddStop(transport::StopIndex& index, std::deque<transport::Stop>& stops, geo::Coordinates coords) {
+        stops.push_back({ "Stop " + std::to_string(stops.size()), coords, stops.size() });
+        index.Add(&stops.back());
+    }
+
+    // A few stops hundreds of cells away from the query and from each other
+    void TestSparseGrid() {
+        transport::StopIndex index;
+        std::deque<transport::Stop> stops;
+        AddStop(index, stops, { 55.0, 40.0 });
+        AddStop(index, stops, { 58.0, 36.0 });
+        AddStop(index, stops, { 50.0, 30.0 });
+        AddStop(index, stops, { 56.0, 37.5 });
+        for (size_t count : { 1, 2, 4, 10 }) {
+            CheckNearest(index, stops, { 55.75, 37.6 }, count,
+                "nearest " + std::to_string(count) + " stops far from the query in a sparse grid");
+        }
+    }
+
+    // A dense city, queried inside and far outside it
+    void TestDenseGrid() {
+        transport::StopIndex index;
+        std::deque<transport::Stop> stops;
+        std::mt19937 random(42);
+        std::uniform_real_distribution<double> latitude(55.5, 56.0);
+        std::uniform_real_distribution<double> longitude(37.3, 37.9);
+        for (int i = 0; i < 2000; ++i) {
+            AddStop(index, stops, { latitude(random), longitude(random) });
+        }
+        for (int i = 0; i < 100; ++i) {
+            CheckNearest(index, stops, { latitude(random), longitude(random) }, 1 + i % 20, "nearest stops in a city");
+        }
+        CheckNearest(index, stops, { 60.0, 30.0 }, 5, "nearest stops of a city far from the query");
+    }
+
+} // namespace
+
+int main() {
+    TestSparseGrid();
+    TestDenseGrid();
+    std::cout << "OK" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,441 @@
+#include "catalogue_snapshot.h"
+
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TC_HAS_MMAP
+#endif
+
+namespace transport {
+
+    namespace {
+
+        const char SNAPSHOT_MAGIC[8] = { 'T', 'C', 'S', 'N', 'A', 'P', '\0', '\0' };
+        const std::uint32_t SNAPSHOT_VERSION = 1;
+        // Reads differently on a host of the other byte order
+        const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+        const size_t ALIGNMENT = 8;
+
+        enum Section {
+            STOP_LATITUDES,
+            STOP_LONGITUDES,
+            // Offsets into STRINGS, one per stop and one past the last name
+            STOP_NAME_OFFSETS,
+            STOPS_BY_NAME,
+            // Offsets into STOP_BUSES, one per stop and one past the end
+            STOP_BUS_OFFSETS,
+            STOP_BUSES,
+            BUS_NAME_OFFSETS,
+            BUS_STOP_OFFSETS,
+            BUS_STOPS,
+            BUS_RECORDS,
+            DISTANCES,
+            STRINGS,
+            SECTION_COUNT
+        };
+
+        struct Header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint64_t size;
+            std::uint64_t stop_count;
+            std::uint64_t bus_count;
+            std::uint64_t distance_count;
+            std::uint64_t section_offsets[SECTION_COUNT];
+            std::uint64_t section_sizes[SECTION_COUNT];
+        };
+
+        static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) % ALIGNMENT == 0);
+        static_assert(std::is_trivially_copyable_v<SnapshotDistance> && sizeof(SnapshotDistance) == 16);
+        static_assert(std::is_trivially_copyable_v<SnapshotBus> && sizeof(SnapshotBus) == 32);
+
+        class SnapshotBuilder {
+        public:
+            SnapshotBuilder()
+                : bytes_(sizeof(Header), '\0') {
+            }
+
+            template <typename T>
+            void AddSection(Section section, const std::vector<T>& values) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                bytes_.resize((bytes_.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, '\0');
+                header_.section_offsets[section] = bytes_.size();
+                header_.section_sizes[section] = values.size() * sizeof(T);
+                bytes_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+            }
+
+            Header& GetHeader() {
+                return header_;
+            }
+
+            void Write(std::ostream& out) {
+                std::memcpy(header_.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+                header_.version = SNAPSHOT_VERSION;
+                header_.byte_order = BYTE_ORDER_MARK;
+                header_.size = bytes_.size();
+                std::memcpy(bytes_.data(), &header_, sizeof(header_));
+                out.write(bytes_.data(), static_cast<std::streamsize>(bytes_.size()));
+            }
+
+        private:
+            Header header_{};
+            std::string bytes_;
+        };
+
+        // Appends a name to the string section and ends its offset list there
+        void AddName(std::string_view name, std::vector<char>& strings, std::vector<std::uint64_t>& offsets) {
+            strings.insert(strings.end(), name.begin(), name.end());
+            offsets.push_back(strings.size());
+        }
+
+        template <typename T>
+        const T* GetSection(std::string_view bytes, const Header& header, Section section, size_t count) {
+            const std::uint64_t offset = header.section_offsets[section];
+            const std::uint64_t size = header.section_sizes[section];
+            if (offset % ALIGNMENT != 0 || offset > bytes.size() || size > bytes.size() - offset
+                || size / sizeof(T) != count || size % sizeof(T) != 0) {
+                throw SnapshotError("Snapshot section is out of bounds");
+            }
+            return reinterpret_cast<const T*>(bytes.data() + offset);
+        }
+
+        // Offsets must not decrease and must stay within the section they point into
+        void CheckOffsets(const std::uint64_t* offsets, size_t count, size_t limit) {
+            if (offsets[0] != 0 || !std::is_sorted(offsets, offsets + count + 1) || offsets[count] > limit) {
+                throw SnapshotError("Snapshot offsets are inconsistent");
+            }
+        }
+
+        void CheckIds(const std::uint32_t* ids, size_t count, size_t limit) {
+            if (std::any_of(ids, ids + count, [limit](std::uint32_t id) { return id >= limit; })) {
+                throw SnapshotError("Snapshot refers to a missing stop or bus");
+            }
+        }
+
+    } // namespace
+
+    void WriteSnapshot(const TransportCatalogue& catalogue, std::ostream& out) {
+        instrumentation::Span span("WriteSnapshot");
+        const auto sorted_stops = catalogue.GetSortedStops();
+        const auto sorted_buses = catalogue.GetSortedBuses();
+        std::vector<const Stop*> stops(catalogue.GetStopCount());
+        std::vector<std::uint32_t> stops_by_name;
+        for (const auto& [name, stop] : sorted_stops) {
+            stops[stop->id] = stop;
+            stops_by_name.push_back(static_cast<std::uint32_t>(stop->id));
+        }
+        std::unordered_map<std::string_view, std::uint32_t> bus_ids;
+        for (const auto& [name, bus] : sorted_buses) {
+            bus_ids.emplace(name, static_cast<std::uint32_t>(bus_ids.size()));
+        }
+
+        std::vector<char> strings;
+        std::vector<double> latitudes;
+        std::vector<double> longitudes;
+        std::vector<std::uint64_t> stop_name_offsets{ 0 };
+        std::vector<std::uint64_t> stop_bus_offsets{ 0 };
+        std::vector<std::uint32_t> stop_buses;
+        for (const Stop* stop : stops) {
+            latitudes.push_back(stop->coords.latitude);
+            longitudes.push_back(stop->coords.longitude);
+            AddName(stop->name, strings, stop_name_offsets);
+
+            std::vector<std::uint32_t> buses;
+            for (const std::string& bus_name : catalogue.GetBusesByStop(stop->name)) {
+                buses.push_back(bus_ids.at(bus_name));
+            }
+            std::sort(buses.begin(), buses.end());
+            stop_buses.insert(stop_buses.end(), buses.begin(), buses.end());
+            stop_bus_offsets.push_back(stop_buses.size());
+        }
+
+        std::vector<std::uint64_t> bus_name_offsets{ strings.size() };
+        std::vector<std::uint64_t> bus_stop_offsets{ 0 };
+        std::vector<std::uint32_t> bus_stops;
+        std::vector<SnapshotBus> bus_records;
+        for (const auto& [name, bus] : sorted_buses) {
+            AddName(name, strings, bus_name_offsets);
+            for (const Stop* stop : bus->stops) {
+                bus_stops.push_back(static_cast<std::uint32_t>(stop->id));
+            }
+            bus_stop_offsets.push_back(bus_stops.size());
+
+            SnapshotBus record{};
+            record.is_roundtrip = bus->is_circular;
+            if (!bus->stops.empty()) {
+                const InfoRoute info = catalogue.GetBusInfo(bus);
+                record = { info.length, info.curvature, static_cast<std::uint32_t>(info.stops_count),
+                    static_cast<std::uint32_t>(info.unique_stops_count), info.is_roundtrip, 0 };
+            }
+            bus_records.push_back(record);
+        }
+
+        std::vector<SnapshotDistance> distances;
+        for (const RoadDistance& road_distance : catalogue.GetRoadDistances()) {
+            distances.push_back({ static_cast<std::uint32_t>(road_distance.from->id),
+                static_cast<std::uint32_t>(road_distance.to->id), road_distance.distance });
+        }
+        std::sort(distances.begin(), distances.end(), [](const SnapshotDistance& lhs, const SnapshotDistance& rhs) {
+            return std::pair(lhs.from, lhs.to) < std::pair(rhs.from, rhs.to);
+            });
+
+        SnapshotBuilder builder;
+        builder.GetHeader().stop_count = stops.size();
+        builder.GetHeader().bus_count = sorted_buses.size();
+        builder.GetHeader().distance_count = distances.size();
+        builder.AddSection(STOP_LATITUDES, latitudes);
+        builder.AddSection(STOP_LONGITUDES, longitudes);
+        builder.AddSection(STOP_NAME_OFFSETS, stop_name_offsets);
+        builder.AddSection(STOPS_BY_NAME, stops_by_name);
+        builder.AddSection(STOP_BUS_OFFSETS, stop_bus_offsets);
+        builder.AddSection(STOP_BUSES, stop_buses);
+        builder.AddSection(BUS_NAME_OFFSETS, bus_name_offsets);
+        builder.AddSection(BUS_STOP_OFFSETS, bus_stop_offsets);
+        builder.AddSection(BUS_STOPS, bus_stops);
+        builder.AddSection(BUS_RECORDS, bus_records);
+        builder.AddSection(DISTANCES, distances);
+        builder.AddSection(STRINGS, strings);
+        builder.Write(out);
+    }
+
+    CatalogueView::CatalogueView(std::string_view bytes)
+        : bytes_(bytes) {
+        Header header;
+        if (bytes.size() < sizeof(header) || reinterpret_cast<std::uintptr_t>(bytes.data()) % ALIGNMENT != 0) {
+            throw SnapshotError("Not a catalogue snapshot");
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            throw SnapshotError("Not a catalogue snapshot");
+        }
+        if (header.version != SNAPSHOT_VERSION || header.byte_order != BYTE_ORDER_MARK) {
+            throw SnapshotError("Catalogue snapshot of another version or byte order");
+        }
+        if (header.size != bytes.size()) {
+            throw SnapshotError("Catalogue snapshot is truncated");
+        }
+
+        stop_count_ = header.stop_count;
+        bus_count_ = header.bus_count;
+        distance_count_ = header.distance_count;
+        stop_latitudes_ = GetSection<double>(bytes, header, STOP_LATITUDES, stop_count_);
+        stop_longitudes_ = GetSection<double>(bytes, header, STOP_LONGITUDES, stop_count_);
+        stop_name_offsets_ = GetSection<std::uint64_t>(bytes, header, STOP_NAME_OFFSETS, stop_count_ + 1);
+        stops_by_name_ = GetSection<std::uint32_t>(bytes, header, STOPS_BY_NAME, stop_count_);
+        stop_bus_offsets_ = GetSection<std::uint64_t>(bytes, header, STOP_BUS_OFFSETS, stop_count_ + 1);
+        bus_name_offsets_ = GetSection<std::uint64_t>(bytes, header, BUS_NAME_OFFSETS, bus_count_ + 1);
+        bus_stop_offsets_ = GetSection<std::uint64_t>(bytes, header, BUS_STOP_OFFSETS, bus_count_ + 1);
+        bus_records_ = GetSection<SnapshotBus>(bytes, header, BUS_RECORDS, bus_count_);
+        distances_ = GetSection<SnapshotDistance>(bytes, header, DISTANCES, distance_count_);
+
+        const size_t stop_bus_count = stop_bus_offsets_[stop_count_];
+        const size_t bus_stop_count = bus_stop_offsets_[bus_count_];
+        const size_t strings_size = header.section_sizes[STRINGS];
+        stop_buses_ = GetSection<std::uint32_t>(bytes, header, STOP_BUSES, stop_bus_count);
+        bus_stops_ = GetSection<std::uint32_t>(bytes, header, BUS_STOPS, bus_stop_count);
+        strings_ = GetSection<char>(bytes, header, STRINGS, strings_size);
+
+        // A linear pass over the index arrays, so lookups need no bounds checks
+        CheckOffsets(stop_name_offsets_, stop_count_, strings_size);
+        CheckOffsets(stop_bus_offsets_, stop_count_, stop_bus_count);
+        CheckOffsets(bus_stop_offsets_, bus_count_, bus_stop_count);
+        if (bus_name_offsets_[0] != stop_name_offsets_[stop_count_]
+            || !std::is_sorted(bus_name_offsets_, bus_name_offsets_ + bus_count_ + 1) || bus_name_offsets_[bus_count_] > strings_size) {
+            throw SnapshotError("Snapshot offsets are inconsistent");
+        }
+        CheckIds(stops_by_name_, stop_count_, stop_count_);
+        CheckIds(stop_buses_, stop_bus_count, bus_count_);
+        CheckIds(bus_stops_, bus_stop_count, stop_count_);
+        if (std::any_of(distances_, distances_ + distance_count_, [this](const SnapshotDistance& distance) {
+            return distance.from >= stop_count_ || distance.to >= stop_count_;
+            })) {
+            throw SnapshotError("Snapshot refers to a missing stop or bus");
+        }
+    }
+
+    size_t CatalogueView::GetStopCount() const {
+        return stop_count_;
+    }
+
+    size_t CatalogueView::GetBusCount() const {
+        return bus_count_;
+    }
+
+    std::string_view CatalogueView::GetString(const std::uint64_t* offsets, std::uint32_t index) const {
+        return std::string_view(strings_ + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+    std::optional<CatalogueView::StopId> CatalogueView::FindStop(std::string_view name) const {
+        const std::uint32_t* end = stops_by_name_ + stop_count_;
+        const std::uint32_t* it = std::lower_bound(stops_by_name_, end, name, [this](std::uint32_t stop, std::string_view name) {
+            return GetStopName(stop) < name;
+            });
+        if (it == end || GetStopName(*it) != name) {
+            return std::nullopt;
+        }
+        return *it;
+    }
+
+    std::string_view CatalogueView::GetStopName(StopId stop) const {
+        return GetString(stop_name_offsets_, stop);
+    }
+
+    geo::Coordinates CatalogueView::GetStopCoordinates(StopId stop) const {
+        return { stop_latitudes_[stop], stop_longitudes_[stop] };
+    }
+
+    CatalogueView::IdRange CatalogueView::GetStopBuses(StopId stop) const {
+        return { stop_buses_ + stop_bus_offsets_[stop], stop_buses_ + stop_bus_offsets_[stop + 1] };
+    }
+
+    std::optional<CatalogueView::BusId> CatalogueView::FindBus(std::string_view name) const {
+        // Buses are numbered in name order
+        BusId first = 0;
+        BusId last = static_cast<BusId>(bus_count_);
+        while (first < last) {
+            const BusId middle = first + (last - first) / 2;
+            if (GetBusName(middle) < name) {
+                first = middle + 1;
+            }
+            else {
+                last = middle;
+            }
+        }
+        if (first == bus_count_ || GetBusName(first) != name) {
+            return std::nullopt;
+        }
+        return first;
+    }
+
+    std::string_view CatalogueView::GetBusName(BusId bus) const {
+        return GetString(bus_name_offsets_, bus);
+    }
+
+    CatalogueView::IdRange CatalogueView::GetBusStops(BusId bus) const {
+        return { bus_stops_ + bus_stop_offsets_[bus], bus_stops_ + bus_stop_offsets_[bus + 1] };
+    }
+
+    bool CatalogueView::IsRoundtrip(BusId bus) const {
+        return bus_records_[bus].is_roundtrip != 0;
+    }
+
+    InfoRoute CatalogueView::GetBusInfo(BusId bus) const {
+        const SnapshotBus& record = bus_records_[bus];
+        return { record.stop_count, record.unique_stop_count, record.route_length, record.curvature, record.is_roundtrip != 0 };
+    }
+
+    const SnapshotDistance* CatalogueView::FindDistance(StopId from, StopId to) const {
+        const SnapshotDistance* end = distances_ + distance_count_;
+        const SnapshotDistance* it = std::lower_bound(distances_, end, std::pair(from, to),
+            [](const SnapshotDistance& distance, const std::pair<StopId, StopId>& stops) {
+                return std::pair(distance.from, distance.to) < stops;
+            });
+        if (it == end || it->from != from || it->to != to) {
+            return nullptr;
+        }
+        return it;
+    }
+
+    std::optional<double> CatalogueView::GetDistance(StopId from, StopId to) const {
+        if (const SnapshotDistance* distance = FindDistance(from, to)) {
+            return distance->distance;
+        }
+        if (const SnapshotDistance* distance = FindDistance(to, from)) {
+            return distance->distance;
+        }
+        return std::nullopt;
+    }
+
+    ranges::Range<const SnapshotDistance*> CatalogueView::GetDistances() const {
+        return { distances_, distances_ + distance_count_ };
+    }
+
+    void LoadCatalogue(const CatalogueView& view, TransportCatalogue& catalogue) {
+        instrumentation::Span span("LoadCatalogue");
+        // Stops are added in id order, so they keep their ids
+        for (CatalogueView::StopId stop = 0; stop < view.GetStopCount(); ++stop) {
+            catalogue.AddStop(view.GetStopName(stop), view.GetStopCoordinates(stop));
+        }
+        for (const SnapshotDistance& distance : view.GetDistances()) {
+            catalogue.SetRoadDistance(catalogue.GetStopByName(view.GetStopName(distance.from)),
+                catalogue.GetStopByName(view.GetStopName(distance.to)), distance.distance);
+        }
+        std::vector<std::string_view> stop_names;
+        for (CatalogueView::BusId bus = 0; bus < view.GetBusCount(); ++bus) {
+            stop_names.clear();
+            for (const CatalogueView::StopId stop : view.GetBusStops(bus)) {
+                stop_names.push_back(view.GetStopName(stop));
+            }
+            catalogue.AddBus(view.GetBusName(bus), stop_names, view.IsRoundtrip(bus));
+        }
+    }
+
+#ifdef TC_HAS_MMAP
+
+    MappedFile::MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(path + ": " + std::strerror(errno));
+        }
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) != 0) {
+            const int error = errno;
+            close(fd);
+            throw std::runtime_error(path + ": " + std::strerror(error));
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                const int error = errno;
+                close(fd);
+                throw std::runtime_error(path + ": " + std::strerror(error));
+            }
+            data_ = static_cast<const char*>(data);
+            is_mapped_ = true;
+        }
+        // The mapping stays valid without the descriptor
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (is_mapped_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error(path + ": cannot open");
+        }
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+
+    MappedFile::~MappedFile() = default;
+
+#endif
+
+    std::string_view MappedFile::GetBytes() const {
+        return std::string_view(data_, size_);
+    }
+
+} // namespace transport
\ No newline at end of file
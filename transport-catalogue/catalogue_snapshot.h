@@ -0,0 +1,125 @@
+#pragma once
+
+#include "domain.h"
+#include "geo.h"
+#include "ranges.h"
+#include "transport_catalogue.h"
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace transport {
+
+    class SnapshotError : public std::runtime_error {
+    public:
+        using runtime_error::runtime_error;
+    };
+
+    // Stops, names, bus stop lists and road distances in one position independent block:
+    // sections are 8 byte aligned arrays referring to each other by index and offset, never
+    // by pointer, so the block can be used right where it is mapped. Numbers are in the byte
+    // order of the writing host, which is checked when the block is opened
+    void WriteSnapshot(const TransportCatalogue& catalogue, std::ostream& out);
+
+    // Road distance record of a snapshot, stops given by their ids
+    struct SnapshotDistance {
+        std::uint32_t from;
+        std::uint32_t to;
+        double distance;
+    };
+
+    // Bus record of a snapshot: the answer to a Bus request, computed when it was written
+    struct SnapshotBus {
+        double route_length;
+        double curvature;
+        std::uint32_t stop_count;
+        std::uint32_t unique_stop_count;
+        std::uint32_t is_roundtrip;
+        std::uint32_t reserved;
+    };
+
+    // Read-only catalogue answering lookups straight from snapshot bytes, e.g. a mapped file:
+    // nothing is parsed or allocated. The bytes must outlive the view and everything it returns
+    class CatalogueView {
+    public:
+        // Stops keep the ids they had in the catalogue, buses are numbered in name order
+        using StopId = std::uint32_t;
+        using BusId = std::uint32_t;
+        using IdRange = ranges::Range<const std::uint32_t*>;
+
+        // Checks the header and that every section lies within the bytes,
+        // throws SnapshotError if they are not a snapshot of this version
+        explicit CatalogueView(std::string_view bytes);
+
+        size_t GetStopCount() const;
+        size_t GetBusCount() const;
+
+        std::optional<StopId> FindStop(std::string_view name) const;
+        std::string_view GetStopName(StopId stop) const;
+        geo::Coordinates GetStopCoordinates(StopId stop) const;
+        // Buses passing the stop, in name order
+        IdRange GetStopBuses(StopId stop) const;
+
+        std::optional<BusId> FindBus(std::string_view name) const;
+        std::string_view GetBusName(BusId bus) const;
+        // Stops as listed for the bus, without the way back of a non-roundtrip bus
+        IdRange GetBusStops(BusId bus) const;
+        bool IsRoundtrip(BusId bus) const;
+        // Computed by the catalogue when the snapshot was written
+        InfoRoute GetBusInfo(BusId bus) const;
+
+        // The distance from one stop to another, or the opposite one if only it is known
+        std::optional<double> GetDistance(StopId from, StopId to) const;
+        // Ordered by from, then by to
+        ranges::Range<const SnapshotDistance*> GetDistances() const;
+
+    private:
+        std::string_view GetString(const std::uint64_t* offsets, std::uint32_t index) const;
+        const SnapshotDistance* FindDistance(StopId from, StopId to) const;
+
+        std::string_view bytes_;
+        size_t stop_count_ = 0;
+        size_t bus_count_ = 0;
+        size_t distance_count_ = 0;
+        const double* stop_latitudes_ = nullptr;
+        const double* stop_longitudes_ = nullptr;
+        const std::uint64_t* stop_name_offsets_ = nullptr;
+        const std::uint32_t* stops_by_name_ = nullptr;
+        const std::uint64_t* stop_bus_offsets_ = nullptr;
+        const std::uint32_t* stop_buses_ = nullptr;
+        const std::uint64_t* bus_name_offsets_ = nullptr;
+        const std::uint64_t* bus_stop_offsets_ = nullptr;
+        const std::uint32_t* bus_stops_ = nullptr;
+        const SnapshotBus* bus_records_ = nullptr;
+        const SnapshotDistance* distances_ = nullptr;
+        const char* strings_ = nullptr;
+    };
+
+    // Fills an empty catalogue from the view; the catalogue keeps no references to the bytes
+    void LoadCatalogue(const CatalogueView& view, TransportCatalogue& catalogue);
+
+    // Read-only shared mapping of a whole file, so processes mapping the same snapshot share
+    // one copy in the page cache. Where mmap is missing the file is read into memory instead
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile();
+
+        std::string_view GetBytes() const;
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        bool is_mapped_ = false;
+        std::string buffer_;
+    };
+
+} // namespace transport
\ No newline at end of file
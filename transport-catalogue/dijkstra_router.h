@@ -0,0 +1,93 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+    // Searches every route on demand instead of precomputing all of them: nothing is stored
+    // besides the graph, and a query costs O((E + V) log V). Safe to query from several threads
+    template <typename Weight>
+    class DijkstraRouter {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+
+    public:
+        using RouteInfo = typename Router<Weight>::RouteInfo;
+
+        explicit DijkstraRouter(const Graph& graph);
+
+        std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    private:
+        static constexpr Weight ZERO_WEIGHT{};
+        const Graph& graph_;
+    };
+
+    template <typename Weight>
+    DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph)
+        : graph_(graph)
+    {
+        const size_t edge_count = graph.GetEdgeCount();
+        for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+            if (graph.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+        }
+    }
+
+    template <typename Weight>
+    std::optional<typename DijkstraRouter<Weight>::RouteInfo> DijkstraRouter<Weight>::BuildRoute(VertexId from,
+        VertexId to) const {
+        const size_t vertex_count = graph_.GetVertexCount();
+        if (from >= vertex_count || to >= vertex_count) {
+            throw std::out_of_range("Vertex is not in the graph");
+        }
+        std::vector<std::optional<Weight>> weights(vertex_count);
+        std::vector<std::optional<EdgeId>> prev_edges(vertex_count);
+
+        using QueueItem = std::pair<Weight, VertexId>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+        weights[from] = ZERO_WEIGHT;
+        queue.push({ ZERO_WEIGHT, from });
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            // Stale entry of a vertex reached cheaper since it was queued
+            if (weight > *weights[vertex]) {
+                continue;
+            }
+            if (vertex == to) {
+                break;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                const Weight candidate_weight = weight + edge.weight;
+                if (!weights[edge.to] || candidate_weight < *weights[edge.to]) {
+                    weights[edge.to] = candidate_weight;
+                    prev_edges[edge.to] = edge_id;
+                    queue.push({ candidate_weight, edge.to });
+                }
+            }
+        }
+
+        if (!weights[to]) {
+            return std::nullopt;
+        }
+        std::vector<EdgeId> edges;
+        for (VertexId vertex = to; vertex != from; vertex = graph_.GetEdge(edges.back()).from) {
+            edges.push_back(*prev_edges[vertex]);
+        }
+        std::reverse(edges.begin(), edges.end());
+        return RouteInfo{ *weights[to], std::move(edges) };
+    }
+
+}  // namespace graph
\ No newline at end of file
@@ -11,6 +11,8 @@ namespace transport {
     struct Stop {
         std::string name;
         geo::Coordinates coords;
+        // Position in the order of addition, indexes per-stop arrays of the catalogue
+        size_t id;
     };
 
     struct BusRoute {
@@ -34,6 +36,19 @@ namespace transport {
         std::vector<std::string> buses;
     };
 
+    struct NearbyStop {
+        const Stop* stop;
+        // Great-circle distance in meters
+        double distance;
+    };
+
+    struct RoadDistance {
+        const Stop* from;
+        const Stop* to;
+        // Meters along the road, not necessarily the same both ways
+        double distance;
+    };
+
     struct StopsHasher {
         size_t operator()(const std::pair<const Stop*, const Stop*>& stops) const {
             std::hash<const void*> ptr_hasher;
@@ -1,9 +1,55 @@
 #include "geo.h"
 
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 
 namespace geo {
 
+    namespace {
+
+        const double EARTH_RADIUS = 6371000;
+
+        // Taylor coefficients of asin(u) / u in powers of u^2,
+        // relative error below 4e-15 for u in [0, 0.5]
+        constexpr double ASIN_COEFFS[] = {
+            1.0, 0.16666666666666666, 0.075, 0.044642857142857144,
+            0.030381944444444444, 0.022372159090909092, 0.017352764423076924, 0.01396484375,
+            0.011551800896139705, 0.009761609529194078, 0.008390335809616815, 0.0073125258735988454,
+            0.006447210311889649, 0.005740037670841924, 0.005153309682319905, 0.004660143486915096,
+            0.004240907093679363, 0.003880964558837669, 0.0035692053938259347, 0.003297059503473485,
+        };
+
+        // Horner scheme unrolled at compile time, so the caller's loop has no inner loop
+        template <size_t I = 0>
+        double AsinPolynomial(double z) {
+            if constexpr (I + 1 == std::size(ASIN_COEFFS)) {
+                return ASIN_COEFFS[I];
+            }
+            else {
+                return ASIN_COEFFS[I] + z * AsinPolynomial<I + 1>(z);
+            }
+        }
+
+        inline double AsinSeries(double u) {
+            return u * AsinPolynomial(u * u);
+        }
+
+        // Written without branches, so far and near points cost the same and
+        // the loop of ComputeDistances vectorizes where the flags allow
+        inline double ChordToDistance(double dx, double dy, double dz) {
+            const double half_chord = std::sqrt(dx * dx + dy * dy + dz * dz) * 0.5;
+            // asin(t) = pi/2 - 2 * asin(sqrt((1 - t) / 2)) keeps the series argument under 0.5:
+            // the smaller of the two candidates is the one to expand
+            const double reduced = std::sqrt(std::max(1.0 - half_chord, 0.0) * 0.5);
+            const double series = AsinSeries(std::min(half_chord, reduced));
+            const double is_far = half_chord > 0.5;
+            const double half_angle = series + is_far * (M_PI_2 - 3.0 * series);
+            return 2.0 * half_angle * EARTH_RADIUS;
+        }
+
+    } // namespace
+
     double ComputeDistance(Coordinates from, Coordinates to) {
         using namespace std;
         if (from == to) {
@@ -16,4 +62,23 @@ namespace geo {
             * earth_rd;
     }
 
+    UnitVector ToUnitVector(Coordinates coords) {
+        static const double dr = M_PI / 180.;
+        const double lat = coords.latitude * dr;
+        const double lon = coords.longitude * dr;
+        return { std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat) };
+    }
+
+    double ComputeDistance(const UnitVector& from, const UnitVector& to) {
+        double distance = 0.0;
+        ComputeDistances(&from, &to, &distance, 1);
+        return distance;
+    }
+
+    void ComputeDistances(const UnitVector* from, const UnitVector* to, double* distances, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            distances[i] = ChordToDistance(to[i].x - from[i].x, to[i].y - from[i].y, to[i].z - from[i].z);
+        }
+    }
+
 } // namespace geo
\ No newline at end of file
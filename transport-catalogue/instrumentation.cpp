@@ -0,0 +1,497 @@
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TC_HAS_PERF_EVENTS
+#endif
+
+namespace instrumentation {
+
+    namespace {
+
+        // Log-linear buckets: 16 per power of two, so a percentile read from
+        // a bucket is within about 6% of the exact sample
+        const int SUB_BUCKET_BITS = 4;
+        const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        int HighestBit(std::uint64_t value) {
+            int bit = 0;
+            while (value >>= 1) {
+                ++bit;
+            }
+            return bit;
+        }
+
+        size_t ToBucket(std::uint64_t value) {
+            if (value < SUB_BUCKETS) {
+                return static_cast<size_t>(value);
+            }
+            const int shift = HighestBit(value) - SUB_BUCKET_BITS;
+            return static_cast<size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1)));
+        }
+
+        // Middle of the values falling into the bucket
+        std::uint64_t FromBucket(size_t bucket) {
+            if (bucket < SUB_BUCKETS) {
+                return bucket;
+            }
+            const int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+            const std::uint64_t lower = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+            return lower + (std::uint64_t{ 1 } << shift) / 2;
+        }
+
+        struct Histogram {
+            std::uint64_t count = 0;
+            std::uint64_t total = 0;
+            std::uint64_t max = 0;
+            std::array<std::uint64_t, BUCKET_COUNT> buckets{};
+
+            void Add(std::uint64_t value) {
+                ++count;
+                total += value;
+                max = std::max(max, value);
+                ++buckets[ToBucket(value)];
+            }
+
+            std::uint64_t Percentile(double fraction) const {
+                const auto rank = static_cast<std::uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+                std::uint64_t seen = 0;
+                for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+                    seen += buckets[bucket];
+                    if (seen >= rank) {
+                        return std::min(FromBucket(bucket), max);
+                    }
+                }
+                return max;
+            }
+        };
+
+        // Totals over all spans of one name, scaled up when the kernel multiplexed the counters
+        struct HardwareTotals {
+            std::uint64_t count = 0;
+            std::array<double, HARDWARE_COUNTER_COUNT> values{};
+            std::array<bool, HARDWARE_COUNTER_COUNT> has_value{};
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::map<std::string, Histogram, std::less<>> histograms;
+            std::map<std::string, std::uint64_t, std::less<>> counters;
+            std::map<std::string, std::uint64_t, std::less<>> memory;
+            std::vector<std::string> log;
+            std::map<std::string, HardwareTotals, std::less<>> hardware;
+            // Why hardware counters were requested but could not be opened
+            std::string hardware_error;
+        };
+
+        Registry& GetRegistry() {
+            static Registry registry;
+            return registry;
+        }
+
+        template <typename Map>
+        typename Map::mapped_type& FindOrAdd(Map& map, std::string_view name) {
+            auto it = map.find(name);
+            if (it == map.end()) {
+                it = map.emplace(std::string(name), typename Map::mapped_type{}).first;
+            }
+            return it->second;
+        }
+
+        double ToMicroseconds(std::uint64_t nanoseconds) {
+            return static_cast<double>(nanoseconds) / 1000.0;
+        }
+
+        const char* const HARDWARE_COUNTER_NAMES[HARDWARE_COUNTER_COUNT] = {
+            "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+        };
+
+#ifdef TC_HAS_PERF_EVENTS
+
+        // One perf event group per thread, read with a single system call.
+        // Only user space is counted, which is allowed at the default perf_event_paranoid level
+        class ThreadCounters {
+        public:
+            ThreadCounters() {
+                const std::pair<std::uint32_t, std::uint64_t> events[HARDWARE_COUNTER_COUNT] = {
+                    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+                    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+                };
+                slots_.fill(-1);
+                for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; ++counter) {
+                    perf_event_attr attr{};
+                    attr.size = sizeof(attr);
+                    attr.type = events[counter].first;
+                    attr.config = events[counter].second;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                    const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, fds_.empty() ? -1 : fds_.front(), 0));
+                    if (fd < 0) {
+                        // Without cycles there is no group; other events may just be missing on this CPU
+                        if (counter == CYCLES) {
+                            error_ = std::string("perf_event_open: ") + std::strerror(errno);
+                            return;
+                        }
+                        continue;
+                    }
+                    slots_[counter] = static_cast<int>(fds_.size());
+                    fds_.push_back(fd);
+                }
+            }
+
+            ThreadCounters(const ThreadCounters&) = delete;
+            ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+            ~ThreadCounters() {
+                for (const int fd : fds_) {
+                    close(fd);
+                }
+            }
+
+            const std::string& GetError() const {
+                return error_;
+            }
+
+            HardwareCounts Read() const {
+                HardwareCounts counts;
+                if (fds_.empty()) {
+                    return counts;
+                }
+                // Number of events, time enabled, time running, then the values in group order
+                std::array<std::uint64_t, 3 + HARDWARE_COUNTER_COUNT> buffer{};
+                const ssize_t size = read(fds_.front(), buffer.data(), sizeof(buffer));
+                if (size < static_cast<ssize_t>(3 * sizeof(std::uint64_t)) || buffer[0] != fds_.size()) {
+                    return counts;
+                }
+                counts.time_enabled = buffer[1];
+                counts.time_running = buffer[2];
+                for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; ++counter) {
+                    if (slots_[counter] >= 0) {
+                        counts.values[counter] = buffer[3 + slots_[counter]];
+                        counts.has_value[counter] = true;
+                    }
+                }
+                counts.is_valid = true;
+                return counts;
+            }
+
+        private:
+            std::vector<int> fds_;
+            // Position of each counter in the group, -1 if it could not be opened
+            std::array<int, HARDWARE_COUNTER_COUNT> slots_;
+            std::string error_;
+        };
+
+        ThreadCounters& GetThreadCounters() {
+            thread_local ThreadCounters counters;
+            return counters;
+        }
+
+#endif
+
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        struct TraceEvent {
+            std::string_view name;
+            TimePoint start;
+            TimePoint end;
+        };
+
+        // Written only by its own thread, read once all threads are done
+        struct ThreadTrace {
+            size_t thread_index;
+            std::vector<TraceEvent> events;
+        };
+
+        struct TraceRegistry {
+            std::mutex mutex;
+            TimePoint start;
+            // Buffers outlive their threads, so worker events survive until the trace is written
+            std::vector<std::unique_ptr<ThreadTrace>> threads;
+        };
+
+        TraceRegistry& GetTraceRegistry() {
+            static TraceRegistry registry;
+            return registry;
+        }
+
+        // The registry lock is taken once per thread, recording itself never locks
+        ThreadTrace& GetThreadTrace() {
+            thread_local ThreadTrace* trace = []() {
+                TraceRegistry& registry = GetTraceRegistry();
+                std::lock_guard lock(registry.mutex);
+                registry.threads.push_back(std::make_unique<ThreadTrace>(ThreadTrace{ registry.threads.size(), {} }));
+                return registry.threads.back().get();
+            }();
+            return *trace;
+        }
+
+        double SinceTraceStart(TimePoint time) {
+            return std::chrono::duration<double, std::micro>(time - GetTraceRegistry().start).count();
+        }
+
+        void PrintJsonString(std::string_view text, std::ostream& out) {
+            out << '"';
+            for (const char c : text) {
+                if (c == '"' || c == '\\') {
+                    out << '\\';
+                }
+                out << c;
+            }
+            out << '"';
+        }
+
+        void PrintTrace(std::ostream& out) {
+            TraceRegistry& registry = GetTraceRegistry();
+            std::lock_guard lock(registry.mutex);
+
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            out << std::fixed << std::setprecision(3);
+            bool is_first = true;
+            for (const auto& thread : registry.threads) {
+                out << (is_first ? "\n" : ",\n");
+                is_first = false;
+                const std::string thread_name = thread->thread_index == 0 ? "main" : "worker " + std::to_string(thread->thread_index);
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->thread_index << ",\"args\":{\"name\":";
+                PrintJsonString(thread_name, out);
+                out << "}}";
+
+                for (const TraceEvent& event : thread->events) {
+                    out << ",\n{\"name\":";
+                    PrintJsonString(event.name, out);
+                    out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->thread_index
+                        << ",\"ts\":" << SinceTraceStart(event.start)
+                        << ",\"dur\":" << std::chrono::duration<double, std::micro>(event.end - event.start).count() << '}';
+                }
+            }
+            out << "\n]}\n";
+        }
+
+    } // namespace
+
+    void Enable() {
+        detail::is_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void EnableTracing() {
+        TraceRegistry& registry = GetTraceRegistry();
+        {
+            std::lock_guard lock(registry.mutex);
+            registry.start = std::chrono::steady_clock::now();
+        }
+        // The thread enabling tracing is listed first
+        GetThreadTrace();
+        detail::is_tracing.store(true, std::memory_order_relaxed);
+    }
+
+    bool EnableHardwareCounters(std::string* error) {
+        std::string reason;
+#ifdef TC_HAS_PERF_EVENTS
+        // Opening them on this thread tells whether they are available at all
+        reason = GetThreadCounters().GetError();
+#else
+        reason = "hardware counters need Linux perf events";
+#endif
+        if (!reason.empty()) {
+            Registry& registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            registry.hardware_error = reason;
+            if (error) {
+                *error = reason;
+            }
+            return false;
+        }
+        detail::is_counting.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    HardwareCounts ReadHardwareCounters() {
+#ifdef TC_HAS_PERF_EVENTS
+        return GetThreadCounters().Read();
+#else
+        return {};
+#endif
+    }
+
+    void RecordHardwareCounts(std::string_view name, const HardwareCounts& start, const HardwareCounts& end) {
+        if (!start.is_valid || !end.is_valid || end.time_running <= start.time_running) {
+            return;
+        }
+        // The group was scheduled only part of the time if other events competed for the counters
+        const double scale = static_cast<double>(end.time_enabled - start.time_enabled)
+            / static_cast<double>(end.time_running - start.time_running);
+
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        HardwareTotals& totals = FindOrAdd(registry.hardware, name);
+        ++totals.count;
+        for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; ++counter) {
+            if (start.has_value[counter] && end.has_value[counter]) {
+                totals.values[counter] += static_cast<double>(end.values[counter] - start.values[counter]) * scale;
+                totals.has_value[counter] = true;
+            }
+        }
+    }
+
+    void Span::Finish() {
+        const TimePoint end = std::chrono::steady_clock::now();
+        if (start_counts_) {
+            RecordHardwareCounts(name_, *start_counts_, ReadHardwareCounters());
+        }
+        if (IsEnabled()) {
+            RecordLatency(name_, end - start_);
+        }
+        if (IsTracing()) {
+            GetThreadTrace().events.push_back({ name_, start_, end });
+        }
+    }
+
+    void RecordLatency(std::string_view name, std::chrono::nanoseconds latency) {
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        FindOrAdd(registry.histograms, name).Add(static_cast<std::uint64_t>(std::max<std::int64_t>(latency.count(), 0)));
+    }
+
+    void AddCount(std::string_view name, std::uint64_t value) {
+        if (!IsEnabled()) {
+            return;
+        }
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        FindOrAdd(registry.counters, name) += value;
+    }
+
+    void RecordMemoryUsage(std::string_view name, std::uint64_t bytes) {
+        if (!IsEnabled()) {
+            return;
+        }
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        std::uint64_t& peak = FindOrAdd(registry.memory, name);
+        peak = std::max(peak, bytes);
+    }
+
+    void Log(std::string message) {
+        if (!IsEnabled()) {
+            return;
+        }
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        registry.log.push_back(std::move(message));
+    }
+
+    void PrintReport(std::ostream& out) {
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+
+        out << std::left << std::setw(32) << "span" << std::right
+            << std::setw(10) << "count" << std::setw(14) << "total_ms"
+            << std::setw(12) << "p50_us" << std::setw(12) << "p99_us" << std::setw(12) << "max_us" << '\n';
+        out << std::fixed << std::setprecision(3);
+        for (const auto& [name, histogram] : registry.histograms) {
+            out << std::left << std::setw(32) << name << std::right
+                << std::setw(10) << histogram.count
+                << std::setw(14) << ToMicroseconds(histogram.total) / 1000.0
+                << std::setw(12) << ToMicroseconds(histogram.Percentile(0.5))
+                << std::setw(12) << ToMicroseconds(histogram.Percentile(0.99))
+                << std::setw(12) << ToMicroseconds(histogram.max) << '\n';
+        }
+
+        if (!registry.hardware_error.empty()) {
+            out << "\nhardware counters unavailable: " << registry.hardware_error << '\n';
+        }
+        else if (!registry.hardware.empty()) {
+            out << '\n' << std::left << std::setw(32) << "span" << std::right << std::setw(10) << "count";
+            for (const char* counter_name : HARDWARE_COUNTER_NAMES) {
+                out << std::setw(16) << counter_name;
+            }
+            out << std::setw(8) << "ipc" << '\n';
+            out << std::setprecision(0);
+            for (const auto& [name, totals] : registry.hardware) {
+                out << std::left << std::setw(32) << name << std::right << std::setw(10) << totals.count;
+                for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; ++counter) {
+                    if (totals.has_value[counter]) {
+                        out << std::setw(16) << totals.values[counter];
+                    }
+                    else {
+                        out << std::setw(16) << "-";
+                    }
+                }
+                out << std::setprecision(2);
+                if (totals.has_value[CYCLES] && totals.has_value[INSTRUCTIONS] && totals.values[CYCLES] > 0) {
+                    out << std::setw(8) << totals.values[INSTRUCTIONS] / totals.values[CYCLES];
+                }
+                else {
+                    out << std::setw(8) << "-";
+                }
+                out << std::setprecision(0) << '\n';
+            }
+        }
+
+        out << '\n' << std::left << std::setw(32) << "counter" << std::right << std::setw(16) << "value" << '\n';
+        for (const auto& [name, value] : registry.counters) {
+            out << std::left << std::setw(32) << name << std::right << std::setw(16) << value << '\n';
+        }
+
+        if (!registry.memory.empty()) {
+            out << '\n' << std::left << std::setw(32) << "memory" << std::right << std::setw(16) << "bytes" << std::setw(12) << "mb" << '\n';
+            out << std::setprecision(3);
+            for (const auto& [name, bytes] : registry.memory) {
+                out << std::left << std::setw(32) << name << std::right << std::setw(16) << bytes
+                    << std::setw(12) << static_cast<double>(bytes) / (1 << 20) << '\n';
+            }
+        }
+
+        if (!registry.log.empty()) {
+            out << "\nlog\n";
+            for (const std::string& line : registry.log) {
+                out << line << '\n';
+            }
+        }
+        out.flush();
+    }
+
+    ReportWriter::ReportWriter(std::string path)
+        : path_(std::move(path)) {
+        Enable();
+    }
+
+    ReportWriter::~ReportWriter() {
+        if (path_.empty()) {
+            PrintReport(std::cerr);
+            return;
+        }
+        std::ofstream out(path_);
+        PrintReport(out);
+    }
+
+    TraceWriter::TraceWriter(std::string path)
+        : path_(std::move(path)) {
+        EnableTracing();
+    }
+
+    TraceWriter::~TraceWriter() {
+        std::ofstream out(path_);
+        PrintTrace(out);
+    }
+
+} // namespace instrumentation
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace instrumentation {
+
+    namespace detail {
+        inline std::atomic<bool> is_enabled = false;
+        inline std::atomic<bool> is_tracing = false;
+        inline std::atomic<bool> is_counting = false;
+    } // namespace detail
+
+    // Everything is off by default: a disabled span or counter costs one relaxed load
+    void Enable();
+
+    inline bool IsEnabled() {
+        return detail::is_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Spans are also recorded as timeline events, each thread into its own buffer
+    void EnableTracing();
+
+    inline bool IsTracing() {
+        return detail::is_tracing.load(std::memory_order_relaxed);
+    }
+
+    // Spans also count cycles, instructions, L1 data and last level cache misses and branch
+    // misses of their thread with Linux perf events. Returns false and sets error if the counters
+    // cannot be opened, e.g. in a container without perf_event_open; spans then only keep time
+    bool EnableHardwareCounters(std::string* error = nullptr);
+
+    inline bool IsCounting() {
+        return detail::is_counting.load(std::memory_order_relaxed);
+    }
+
+    enum HardwareCounter {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        HARDWARE_COUNTER_COUNT
+    };
+
+    // Counter values of the calling thread since its counters were opened,
+    // is_valid is false if they could not be read
+    struct HardwareCounts {
+        std::array<std::uint64_t, HARDWARE_COUNTER_COUNT> values{};
+        std::array<bool, HARDWARE_COUNTER_COUNT> has_value{};
+        std::uint64_t time_enabled = 0;
+        std::uint64_t time_running = 0;
+        bool is_valid = false;
+    };
+
+    HardwareCounts ReadHardwareCounters();
+
+    // Adds the counts between start and end to the hardware counter totals of name
+    void RecordHardwareCounts(std::string_view name, const HardwareCounts& start, const HardwareCounts& end);
+
+    // Adds a sample to the latency histogram of name
+    void RecordLatency(std::string_view name, std::chrono::nanoseconds latency);
+    void AddCount(std::string_view name, std::uint64_t value = 1);
+    // Adds a line to the log section of the report, e.g. a decision made from the input
+    void Log(std::string message);
+    // Heap bytes of a structure; the report shows the largest value recorded under the name
+    void RecordMemoryUsage(std::string_view name, std::uint64_t bytes);
+
+    // Time between construction and destruction on the monotonic clock.
+    // The name is not copied, so it should be a string literal
+    class Span {
+    public:
+        explicit Span(std::string_view name)
+            : name_(name)
+            , is_active_(IsEnabled() || IsTracing() || IsCounting()) {
+            if (is_active_) {
+                if (IsCounting()) {
+                    start_counts_.emplace(ReadHardwareCounters());
+                }
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        ~Span() {
+            if (is_active_) {
+                Finish();
+            }
+        }
+
+    private:
+        void Finish();
+
+        std::string_view name_;
+        bool is_active_;
+        std::chrono::steady_clock::time_point start_;
+        std::optional<HardwareCounts> start_counts_;
+    };
+
+    // Count, total, p50, p99 and max of every histogram, the hardware counters of spans
+    // if they are enabled, then the counters, memory usage and log
+    void PrintReport(std::ostream& out);
+
+    // Enables instrumentation and prints the report when destroyed,
+    // into the file at path or to stderr if the path is empty
+    class ReportWriter {
+    public:
+        explicit ReportWriter(std::string path);
+
+        ReportWriter(const ReportWriter&) = delete;
+        ReportWriter& operator=(const ReportWriter&) = delete;
+
+        ~ReportWriter();
+
+    private:
+        std::string path_;
+    };
+
+    // Enables tracing and writes the recorded spans as a Chrome trace-event JSON file
+    // when destroyed. All threads that recorded spans must have finished by then
+    class TraceWriter {
+    public:
+        explicit TraceWriter(std::string path);
+
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        ~TraceWriter();
+
+    private:
+        std::string path_;
+    };
+
+} // namespace instrumentation
\ No newline at end of file
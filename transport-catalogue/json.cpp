@@ -1,5 +1,8 @@
 ﻿#include "json.h"
 
+#include "instrumentation.h"
+#include "memory_usage.h"
+
 using namespace std;
 
 namespace json {
@@ -303,7 +306,34 @@ namespace json {
     }
 
     Document Load(istream& input) {
-        return Document{ LoadNode(input) };
+        instrumentation::Span span("json.Load");
+        Document doc{ LoadNode(input) };
+        if (instrumentation::IsEnabled()) {
+            instrumentation::RecordMemoryUsage("json.dom", GetMemoryUsage(doc.GetRoot()));
+        }
+        return doc;
+    }
+
+    size_t GetMemoryUsage(const Node& node) {
+        const Node::Value& value = node.GetValue();
+        if (const auto* text = std::get_if<std::string>(&value)) {
+            return memory::StringBytes(*text);
+        }
+        if (const auto* array = std::get_if<Array>(&value)) {
+            size_t bytes = memory::VectorBytes(*array);
+            for (const Node& item : *array) {
+                bytes += GetMemoryUsage(item);
+            }
+            return bytes;
+        }
+        if (const auto* dict = std::get_if<Dict>(&value)) {
+            size_t bytes = memory::TreeMapBytes(*dict);
+            for (const auto& [key, item] : *dict) {
+                bytes += memory::StringBytes(key) + GetMemoryUsage(item);
+            }
+            return bytes;
+        }
+        return 0;
     }
 
     void PrintValue(std::nullptr_t, const PrintContext& ctx) {
@@ -75,6 +75,9 @@ namespace json {
 
     Document Load(std::istream& input);
 
+    // Heap bytes held by the node and everything below it
+    size_t GetMemoryUsage(const Node& node);
+
     struct PrintContext {
         std::ostream& out;
         int indent_step = 4;
@@ -1,7 +1,92 @@
 #include "json_reader.h"
 
+#include "instrumentation.h"
+
+#include <unordered_set>
+
 namespace json_reader {
 
+    namespace {
+
+        [[noreturn]] void ThrowInvalidPatch(const std::string& message) {
+            throw std::logic_error("Invalid patch request: " + message);
+        }
+
+        bool HasField(const json::Dict& request, const std::string& key, bool (json::Node::*is_type)() const) {
+            const auto it = request.find(key);
+            return it != request.end() && (it->second.*is_type)();
+        }
+
+    } // namespace
+
+    void CheckPatchRequests(const transport::TransportCatalogue& catalogue, const json::Array& patch_requests) {
+        // Stops the patch adds, distances and buses of the same patch may refer to them
+        std::unordered_set<std::string_view> new_stops;
+        for (const auto& request : patch_requests) {
+            if (!request.IsMap() || !HasField(request.AsMap(), "type", &json::Node::IsString)
+                || !HasField(request.AsMap(), "name", &json::Node::IsString)) {
+                ThrowInvalidPatch("a request without a type or a name");
+            }
+            const auto& request_map = request.AsMap();
+            const std::string& type = request_map.at("type").AsString();
+            const std::string& name = request_map.at("name").AsString();
+            if (type == "Stop") {
+                const bool has_latitude = request_map.count("latitude") > 0;
+                if (has_latitude != (request_map.count("longitude") > 0)) {
+                    ThrowInvalidPatch(name + ": latitude and longitude go together");
+                }
+                if (has_latitude && (!HasField(request_map, "latitude", &json::Node::IsDouble)
+                    || !HasField(request_map, "longitude", &json::Node::IsDouble))) {
+                    ThrowInvalidPatch(name + ": coordinates are not numbers");
+                }
+                if (!catalogue.GetStopByName(name)) {
+                    if (!has_latitude) {
+                        ThrowInvalidPatch(name + ": a new stop without coordinates");
+                    }
+                    new_stops.insert(name);
+                }
+            }
+            else if (type != "Bus") {
+                ThrowInvalidPatch(name + ": unknown type " + type);
+            }
+        }
+
+        const auto is_known_stop = [&](const std::string& name) {
+            return catalogue.GetStopByName(name) || new_stops.count(name) > 0;
+        };
+        for (const auto& request : patch_requests) {
+            const auto& request_map = request.AsMap();
+            const std::string& name = request_map.at("name").AsString();
+            if (request_map.at("type").AsString() == "Stop") {
+                if (!request_map.count("road_distances")) {
+                    continue;
+                }
+                if (!HasField(request_map, "road_distances", &json::Node::IsMap)) {
+                    ThrowInvalidPatch(name + ": road_distances is not a dict");
+                }
+                for (const auto& [other_stop_name, distance_node] : request_map.at("road_distances").AsMap()) {
+                    if (!distance_node.IsDouble()) {
+                        ThrowInvalidPatch(name + ": the distance to " + other_stop_name + " is not a number");
+                    }
+                    if (!is_known_stop(other_stop_name)) {
+                        ThrowInvalidPatch(name + ": a distance to the unknown stop " + other_stop_name);
+                    }
+                }
+                continue;
+            }
+
+            if (!HasField(request_map, "is_roundtrip", &json::Node::IsBool)
+                || !HasField(request_map, "stops", &json::Node::IsArray) || request_map.at("stops").AsArray().empty()) {
+                ThrowInvalidPatch(name + ": a bus needs stops and is_roundtrip");
+            }
+            for (const auto& stop_node : request_map.at("stops").AsArray()) {
+                if (!stop_node.IsString() || !is_known_stop(stop_node.AsString())) {
+                    ThrowInvalidPatch(name + ": an unknown stop on the bus");
+                }
+            }
+        }
+    }
+
     void ParseStop(transport::TransportCatalogue& catalogue, const json::Dict& stop_map) {
         const std::string& name = stop_map.at("name").AsString();
         const auto& latitude = stop_map.at("latitude").AsDouble();
@@ -40,6 +125,7 @@ namespace json_reader {
     }
 
     void ParseBaseRequests(transport::TransportCatalogue& catalogue, const json::Array& base_requests) {
+        instrumentation::Span span("json_reader.ParseBaseRequests");
         for (const auto& request : base_requests) {
             const auto& type = request.AsMap().at("type").AsString();
 
@@ -63,6 +149,36 @@ namespace json_reader {
                 ParseBus(catalogue, request.AsMap());
             }
         }
+
+        if (instrumentation::IsEnabled()) {
+            for (const auto& [part, bytes] : catalogue.GetMemoryUsage()) {
+                instrumentation::RecordMemoryUsage(part, bytes);
+            }
+        }
+    }
+
+    void ParsePatchRequests(transport::TransportCatalogue& catalogue, const json::Array& patch_requests) {
+        instrumentation::Span span("json_reader.ParsePatchRequests");
+        CheckPatchRequests(catalogue, patch_requests);
+
+        for (const auto& request : patch_requests) {
+            const auto& request_map = request.AsMap();
+            if (request_map.at("type").AsString() == "Stop" && request_map.count("latitude")) {
+                ParseStop(catalogue, request_map);
+            }
+        }
+
+        for (const auto& request : patch_requests) {
+            if (request.AsMap().at("type").AsString() == "Stop") {
+                ParseDistance(catalogue, request.AsMap());
+            }
+        }
+
+        for (const auto& request : patch_requests) {
+            if (request.AsMap().at("type").AsString() == "Bus") {
+                ParseBus(catalogue, request.AsMap());
+            }
+        }
     }
 
     svg::Color ParseColor(const json::Node& color_node) {
@@ -106,13 +222,122 @@ namespace json_reader {
             settings.color_palette.push_back(ParseColor(color_element));
         }
 
+        if (const auto it = render_settings.find("simplify_tolerance"); it != render_settings.end()) {
+            settings.simplify_tolerance = it->second.AsDouble();
+        }
+        if (const auto it = render_settings.find("cull_overlapping_labels"); it != render_settings.end()) {
+            settings.cull_overlapping_labels = it->second.AsBool();
+        }
+        if (const auto it = render_settings.find("use_style_classes"); it != render_settings.end()) {
+            settings.use_style_classes = it->second.AsBool();
+        }
+
         return settings;
     }
 
     transport::Router ParseRouterSettings(const json::Dict& settings) {
-        transport::Router routing_settings;
+        transport::Router routing_settings{ settings.at("bus_wait_time").AsInt(), settings.at("bus_velocity").AsDouble() };
+
+        // "auto" unless given
+        if (const auto it = settings.find("strategy"); it != settings.end()) {
+            const std::string& strategy = it->second.AsString();
+            if (strategy == "all_pairs") {
+                routing_settings.SetStrategy(transport::RoutingStrategy::ALL_PAIRS);
+            }
+            else if (strategy == "dijkstra") {
+                routing_settings.SetStrategy(transport::RoutingStrategy::DIJKSTRA);
+            }
+            else if (strategy == "fastest") {
+                routing_settings.SetStrategy(transport::RoutingStrategy::FASTEST);
+            }
+            else if (strategy != "auto") {
+                throw std::logic_error("Invalid routing strategy");
+            }
+        }
+        return routing_settings;
+    }
+
+    geo::BoundingBox ParseViewport(const json::Dict& viewport) {
+        return geo::BoundingBox{
+            { viewport.at("min_latitude").AsDouble(), viewport.at("min_longitude").AsDouble() },
+            { viewport.at("max_latitude").AsDouble(), viewport.at("max_longitude").AsDouble() } };
+    }
+
+    std::vector<request_handler::StatRequest> ParseStatRequests(const transport::TransportCatalogue& catalogue, const json::Array& stat_requests) {
+        instrumentation::Span span("json_reader.ParseStatRequests");
+        std::vector<request_handler::StatRequest> requests;
+        requests.reserve(stat_requests.size());
+
+        for (const auto& request : stat_requests) {
+            const auto& request_map = request.AsMap();
+            const auto& type = request_map.at("type").AsString();
+            const int id = request_map.at("id").AsInt();
+
+            if (type == "Stop") {
+                requests.push_back(request_handler::StopStatRequest{ id, catalogue.GetStopByName(request_map.at("name").AsString()) });
+            }
+            else if (type == "Bus") {
+                requests.push_back(request_handler::BusStatRequest{ id, catalogue.GetBusByName(request_map.at("name").AsString()) });
+            }
+            else if (type == "Map") {
+                request_handler::MapStatRequest map_request{ id, std::nullopt };
+                if (const auto it = request_map.find("viewport"); it != request_map.end()) {
+                    map_request.viewport = ParseViewport(it->second.AsMap());
+                }
+                requests.push_back(std::move(map_request));
+            }
+            else if (type == "Route") {
+                requests.push_back(request_handler::RouteStatRequest{ id,
+                    catalogue.GetStopByName(request_map.at("from").AsString()),
+                    catalogue.GetStopByName(request_map.at("to").AsString()) });
+            }
+            else if (type == "RouteMap") {
+                requests.push_back(request_handler::RouteMapStatRequest{ id,
+                    catalogue.GetStopByName(request_map.at("from").AsString()),
+                    catalogue.GetStopByName(request_map.at("to").AsString()) });
+            }
+            else if (type == "Nearby") {
+                request_handler::NearbyStatRequest nearby_request{ id,
+                    { request_map.at("latitude").AsDouble(), request_map.at("longitude").AsDouble() },
+                    std::nullopt, std::nullopt };
+                if (const auto it = request_map.find("count"); it != request_map.end()) {
+                    nearby_request.count = static_cast<size_t>(std::max(it->second.AsInt(), 0));
+                    if (const auto radius_it = request_map.find("radius"); radius_it != request_map.end()) {
+                        nearby_request.radius = radius_it->second.AsDouble();
+                    }
+                }
+                else {
+                    nearby_request.radius = request_map.at("radius").AsDouble();
+                }
+                requests.push_back(nearby_request);
+            }
+        }
+
+        return requests;
+    }
+
+    std::optional<std::vector<request_handler::SnapshotStatRequest>> ParseSnapshotStatRequests(const transport::CatalogueView& view, const json::Array& stat_requests) {
+        instrumentation::Span span("json_reader.ParseSnapshotStatRequests");
+        std::vector<request_handler::SnapshotStatRequest> requests;
+        requests.reserve(stat_requests.size());
+
+        for (const auto& request : stat_requests) {
+            const auto& request_map = request.AsMap();
+            const auto& type = request_map.at("type").AsString();
+            const int id = request_map.at("id").AsInt();
+
+            if (type == "Stop") {
+                requests.push_back(request_handler::SnapshotStopRequest{ id, view.FindStop(request_map.at("name").AsString()) });
+            }
+            else if (type == "Bus") {
+                requests.push_back(request_handler::SnapshotBusRequest{ id, view.FindBus(request_map.at("name").AsString()) });
+            }
+            else {
+                return std::nullopt;
+            }
+        }
 
-        return transport::Router{ settings.at("bus_wait_time").AsInt(), settings.at("bus_velocity").AsDouble() };
+        return requests;
     }
 
 } // namespace json_reader
@@ -4,6 +4,7 @@
 #include "transport_catalogue.h"
 #include "transport_router.h"
 #include "map_renderer.h"
+#include "request_handler.h"
 
 #include <algorithm>
 
@@ -13,8 +14,19 @@ namespace json_reader {
     void ParseDistance(transport::TransportCatalogue& catalogue, const json::Dict& stop_map);
     void ParseBus(transport::TransportCatalogue& catalogue, const json::Dict& bus_map);
     void ParseBaseRequests(transport::TransportCatalogue& catalogue, const json::Array& base_requests);
+    // Throws std::logic_error unless every field is there with its type and every stop referred to
+    // is known or added by the patch; unlike base requests, unknown stops are not skipped
+    void CheckPatchRequests(const transport::TransportCatalogue& catalogue, const json::Array& patch_requests);
+    // Same requests as base ones applied on top of a loaded catalogue: known stops and buses are replaced,
+    // a stop without coordinates only updates its road distances. Checked by CheckPatchRequests first,
+    // so a rejected patch changes nothing
+    void ParsePatchRequests(transport::TransportCatalogue& catalogue, const json::Array& patch_requests);
     svg::Color ParseColor(const json::Node& color_node);
     map::RenderSettings ParseRenderSettings(const json::Dict& render_settings);
     transport::Router ParseRouterSettings(const json::Dict& reder_settings);
+    geo::BoundingBox ParseViewport(const json::Dict& viewport);
+    std::vector<request_handler::StatRequest> ParseStatRequests(const transport::TransportCatalogue& catalogue, const json::Array& stat_requests);
+    // Stop and Bus requests resolved in a snapshot, std::nullopt if there are others needing a loaded catalogue
+    std::optional<std::vector<request_handler::SnapshotStatRequest>> ParseSnapshotStatRequests(const transport::CatalogueView& view, const json::Array& stat_requests);
 
 } // namespace json_reader
@@ -4,31 +4,170 @@
 #include "request_handler.h"
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "instrumentation.h"
+#include "server.h"
+#include "catalogue_snapshot.h"
 
-int main() {
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
 
-    transport::TransportCatalogue catalogue;
-    json::Document doc = json::Load(std::cin);
-    const auto& root = doc.GetRoot().AsMap();
+int main(int argc, char* argv[]) {
+    using namespace std::literals;
 
-    const auto& base_requests = root.at("base_requests").AsArray();
-    json_reader::ParseBaseRequests(catalogue, base_requests);
+    // --threads N answers stat requests on N threads, 0 meaning one per core.
+    // --serve keeps answering stat request documents from stdin after the base one,
+    // --socket PATH answers them on a Unix domain socket, --client PATH talks to it.
+    // --profile prints phase and request timings to stderr on exit, --profile-file PATH into a file,
+    // --trace PATH writes a timeline of the same spans for a trace viewer,
+    // --perf-counters adds hardware counters of the spans to the report where perf events are allowed.
+    // --memory-budget MB keeps the router within the budget, choosing a search per query over
+    // the precomputed route table or refusing to start if even that does not fit.
+    // --save-snapshot PATH writes the catalogue built from base_requests into a binary file,
+    // --snapshot PATH maps such a file instead of reading base_requests and answers Stop and Bus
+    // requests from the mapping, loading a catalogue from it only for other requests.
+    // patch_requests in the document are applied on top of either before the snapshot is saved,
+    // so --snapshot OLD --save-snapshot NEW turns a day's changes into a new snapshot
+    std::optional<instrumentation::ReportWriter> report;
+    std::optional<instrumentation::TraceWriter> trace;
+    size_t thread_count = 1;
+    bool serve = false;
+    std::string socket_path;
+    std::string client_path;
+    bool count_hardware = false;
+    std::optional<size_t> memory_budget;
+    std::string snapshot_path;
+    std::string save_snapshot_path;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == "--serve"sv) {
+            serve = true;
+        }
+        else if (argv[i] == "--profile"sv) {
+            report.emplace(std::string());
+        }
+        else if (argv[i] == "--perf-counters"sv) {
+            count_hardware = true;
+        }
+        else if (i + 1 < argc && argv[i] == "--profile-file"sv) {
+            report.emplace(argv[++i]);
+        }
+        else if (i + 1 < argc && argv[i] == "--trace"sv) {
+            trace.emplace(argv[++i]);
+        }
+        else if (i + 1 < argc && argv[i] == "--threads"sv) {
+            thread_count = std::stoul(argv[++i]);
+        }
+        else if (i + 1 < argc && argv[i] == "--memory-budget"sv) {
+            memory_budget = std::stoull(argv[++i]) << 20;
+        }
+        else if (i + 1 < argc && argv[i] == "--snapshot"sv) {
+            snapshot_path = argv[++i];
+        }
+        else if (i + 1 < argc && argv[i] == "--save-snapshot"sv) {
+            save_snapshot_path = argv[++i];
+        }
+        else if (i + 1 < argc && argv[i] == "--socket"sv) {
+            socket_path = argv[++i];
+        }
+        else if (i + 1 < argc && argv[i] == "--client"sv) {
+            client_path = argv[++i];
+        }
+    }
 
-    const auto& render_settings = root.at("render_settings").AsMap();
-    const auto& render = json_reader::ParseRenderSettings(render_settings);
+    if (count_hardware) {
+        if (!report) {
+            report.emplace(std::string());
+        }
+        std::string error;
+        if (!instrumentation::EnableHardwareCounters(&error)) {
+            std::cerr << "Hardware counters are off: " << error << std::endl;
+        }
+    }
 
-    map::MapRenderer map_renderer(render, catalogue);
+    try {
+        if (!client_path.empty()) {
+            server::RunClient(client_path, std::cin, std::cout);
+            return 0;
+        }
 
-    const auto& routing_settings = root.at("routing_settings").AsMap();
-    const auto& router_set = json_reader::ParseRouterSettings(routing_settings);
+        json::Document doc = json::Load(std::cin);
+        const auto& root = doc.GetRoot().AsMap();
+        // Mapped for the whole run: Stop and Bus requests are answered from the mapping itself,
+        // shared with every process using the same snapshot
+        std::optional<transport::MappedFile> snapshot;
+        if (!snapshot_path.empty()) {
+            snapshot.emplace(snapshot_path);
+        }
 
-    transport::Router router{ router_set, catalogue };
+        // Only Route, Map and Nearby requests or a patch need the catalogue loaded
+        if (snapshot && !serve && socket_path.empty() && !root.count("patch_requests") && save_snapshot_path.empty()) {
+            const transport::CatalogueView view(snapshot->GetBytes());
+            if (const auto stat_requests = json_reader::ParseSnapshotStatRequests(view, root.at("stat_requests").AsArray())) {
+                request_handler::PrintSnapshotResponses(view, *stat_requests, std::cout);
+                return 0;
+            }
+        }
 
-    const auto& stat_requests = root.at("stat_requests").AsArray();
-    request_handler::RequestHandler request_handler(map_renderer);
+        transport::TransportCatalogue catalogue;
+        if (snapshot) {
+            transport::LoadCatalogue(transport::CatalogueView(snapshot->GetBytes()), catalogue);
+        }
+        else {
+            json_reader::ParseBaseRequests(catalogue, root.at("base_requests").AsArray());
+        }
+        if (const auto it = root.find("patch_requests"); it != root.end()) {
+            json_reader::ParsePatchRequests(catalogue, it->second.AsArray());
+        }
+        if (!save_snapshot_path.empty()) {
+            std::ofstream out(save_snapshot_path, std::ios::binary);
+            transport::WriteSnapshot(catalogue, out);
+            if (!out) {
+                throw std::runtime_error(save_snapshot_path + ": cannot write the snapshot");
+            }
+        }
 
-    json::Array responses = request_handler.ParseStatRequests(catalogue, stat_requests, map_renderer, router);
-    json::Document response_doc{ std::move(responses) };
-    json::Print(response_doc, std::cout);
+        const auto& render_settings = root.at("render_settings").AsMap();
+        transport::Router routing_settings = json_reader::ParseRouterSettings(root.at("routing_settings").AsMap());
+        if (memory_budget) {
+            routing_settings.SetMemoryBudget(*memory_budget);
+        }
 
-}
+        if (!serve && socket_path.empty()) {
+            const auto stat_requests = json_reader::ParseStatRequests(catalogue, root.at("stat_requests").AsArray());
+            routing_settings.SetRouteQueryCount(request_handler::CountRouteRequests(stat_requests));
+            if (request_handler::NeedsRouter(stat_requests)) {
+                transport::CheckRouterMemory(routing_settings, catalogue);
+            }
+            request_handler::RequestHandler request_handler(catalogue,
+                json_reader::ParseRenderSettings(render_settings), std::move(routing_settings));
+            if (request_handler::NeedsRouter(stat_requests)) {
+                request_handler.PrecomputeRouter();
+            }
+            request_handler.PrintStatResponses(stat_requests, std::cout, thread_count);
+            return 0;
+        }
+
+        // A server answers route requests sooner or later
+        transport::CheckRouterMemory(routing_settings, catalogue);
+        request_handler::RequestHandler request_handler(catalogue,
+            json_reader::ParseRenderSettings(render_settings), std::move(routing_settings));
+        request_handler.PrecomputeRouter();
+        const server::Services services{ catalogue, request_handler, thread_count };
+        if (root.count("stat_requests")) {
+            // Patches of the document are applied already
+            server::AnswerBatch(root.at("stat_requests"), services, std::cout);
+        }
+        if (!socket_path.empty()) {
+            server::ServeSocket(socket_path, services);
+        }
+        else {
+            server::ServeStream(std::cin, std::cout, services);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+}
\ No newline at end of file
@@ -1,188 +1,848 @@
 #include "map_renderer.h"
 
+#include "instrumentation.h"
+
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <thread>
+
 namespace map {
 
+    namespace {
+
+        const svg::Color NONE_COLOR{ std::string("none") };
+        const svg::Color WHITE_COLOR{ std::string("white") };
+        const svg::Color BLACK_COLOR{ std::string("black") };
+
+        const std::string_view BUS_UNDERLAYER_CLASS = "bu";
+        const std::string_view STOP_CLASS = "s";
+        const std::string_view STOP_UNDERLAYER_CLASS = "su";
+        const std::string_view STOP_LABEL_CLASS = "st";
+
+        // Rough upper bounds of a single element, used only to pre-size the output
+        const size_t SVG_POINT_SIZE = 24;
+        const size_t SVG_ELEMENT_SIZE = 256;
+
+        // Layers are split into chunks of at least this many buses or stops;
+        // maps smaller than one chunk per layer are rendered on the calling thread
+        const size_t MIN_RENDER_CHUNK = 256;
+
+        // Splits [0, count) into consecutive chunks, one per hardware thread at most
+        std::vector<std::pair<size_t, size_t>> SplitIntoChunks(size_t count) {
+            const size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+            const size_t chunk_size = std::max(MIN_RENDER_CHUNK, (count + threads - 1) / threads);
+
+            std::vector<std::pair<size_t, size_t>> chunks;
+            for (size_t first = 0; first < count; first += chunk_size) {
+                chunks.emplace_back(first, std::min(count, first + chunk_size));
+            }
+            return chunks;
+        }
+
+        size_t GetRoutePointCount(const transport::BusRoute& route) {
+            return route.is_circular ? route.stops.size() : route.stops.size() * 2 - 1;
+        }
+
+        const transport::Stop* GetRoutePoint(const transport::BusRoute& route, size_t index) {
+            return index < route.stops.size() ? route.stops[index] : route.stops[route.stops.size() * 2 - 2 - index];
+        }
+
+        double SegmentDistance(geo::Coordinates point, geo::Coordinates from, geo::Coordinates to) {
+            const double dx = to.longitude - from.longitude;
+            const double dy = to.latitude - from.latitude;
+            const double length_sq = dx * dx + dy * dy;
+            double t = 0.0;
+            if (length_sq > 0.0) {
+                t = std::clamp(((point.longitude - from.longitude) * dx + (point.latitude - from.latitude) * dy) / length_sq, 0.0, 1.0);
+            }
+            return std::hypot(point.longitude - (from.longitude + t * dx), point.latitude - (from.latitude + t * dy));
+        }
+
+        // Douglas-Peucker over the first point_count route points. The projection is a uniform
+        // scale, so simplifying in degrees with tolerance / zoom equals simplifying in pixels
+        std::vector<size_t> SimplifyRoute(const transport::BusRoute& route, size_t point_count, double tolerance) {
+            std::vector<bool> is_kept(point_count, false);
+            is_kept.front() = true;
+            is_kept.back() = true;
+
+            std::vector<std::pair<size_t, size_t>> ranges{ { 0, point_count - 1 } };
+            while (!ranges.empty()) {
+                const auto [first, last] = ranges.back();
+                ranges.pop_back();
+
+                double max_distance = 0.0;
+                size_t farthest = first;
+                for (size_t i = first + 1; i < last; ++i) {
+                    const double distance = SegmentDistance(GetRoutePoint(route, i)->coords,
+                        GetRoutePoint(route, first)->coords, GetRoutePoint(route, last)->coords);
+                    if (distance > max_distance) {
+                        max_distance = distance;
+                        farthest = i;
+                    }
+                }
+
+                if (max_distance > tolerance) {
+                    is_kept[farthest] = true;
+                    ranges.emplace_back(first, farthest);
+                    ranges.emplace_back(farthest, last);
+                }
+            }
+
+            std::vector<size_t> kept_points;
+            for (size_t i = 0; i < point_count; ++i) {
+                if (is_kept[i]) {
+                    kept_points.push_back(i);
+                }
+            }
+            return kept_points;
+        }
+
+        // Calls add_point with the screen points of the line, the ends of the piece always included
+        // so that pieces of simplified lines still reach the viewport border
+        template <typename Line, typename AddPoint>
+        void ForEachLinePoint(const Line& line, const StopPositions& stop_positions, AddPoint add_point) {
+            if (!line.clipped_points.empty()) {
+                for (const svg::Point& point : line.clipped_points) {
+                    add_point(point);
+                }
+            }
+            else if (line.kept_points) {
+                add_point(stop_positions(GetRoutePoint(*line.route, line.first)));
+                const auto kept_begin = std::upper_bound(line.kept_points->begin(), line.kept_points->end(), line.first);
+                const auto kept_end = std::lower_bound(kept_begin, line.kept_points->end(), line.last - 1);
+                for (auto it = kept_begin; it != kept_end; ++it) {
+                    add_point(stop_positions(GetRoutePoint(*line.route, *it)));
+                }
+                if (line.last - 1 > line.first) {
+                    add_point(stop_positions(GetRoutePoint(*line.route, line.last - 1)));
+                }
+            }
+            else {
+                for (size_t point = line.first; point < line.last; ++point) {
+                    add_point(stop_positions(GetRoutePoint(*line.route, point)));
+                }
+            }
+        }
+
+        struct ClipBox {
+            double min_x;
+            double min_y;
+            double max_x;
+            double max_y;
+
+            bool Contains(svg::Point point) const {
+                return min_x <= point.x && point.x <= max_x && min_y <= point.y && point.y <= max_y;
+            }
+        };
+
+        // Liang-Barsky: cuts the segment to its part inside the box, false if nothing is inside.
+        // The flags tell whether each end was moved to the border
+        bool ClipSegment(svg::Point& from, svg::Point& to, const ClipBox& box, bool& from_clipped, bool& to_clipped) {
+            const double dx = to.x - from.x;
+            const double dy = to.y - from.y;
+            double t_from = 0.0;
+            double t_to = 1.0;
+            const std::pair<double, double> edges[] = {
+                { -dx, from.x - box.min_x }, { dx, box.max_x - from.x },
+                { -dy, from.y - box.min_y }, { dy, box.max_y - from.y },
+            };
+            for (const auto& [p, q] : edges) {
+                if (p == 0.0) {
+                    if (q < 0.0) {
+                        return false;
+                    }
+                    continue;
+                }
+                const double t = q / p;
+                if (p < 0.0) {
+                    t_from = std::max(t_from, t);
+                }
+                else {
+                    t_to = std::min(t_to, t);
+                }
+            }
+            if (t_from > t_to) {
+                return false;
+            }
+
+            from_clipped = t_from > 0.0;
+            to_clipped = t_to < 1.0;
+            const svg::Point start = from;
+            if (from_clipped) {
+                from = { start.x + t_from * dx, start.y + t_from * dy };
+            }
+            if (to_clipped) {
+                to = { start.x + t_to * dx, start.y + t_to * dy };
+            }
+            return true;
+        }
+
+        // The projection is linear in latitude and longitude, so a segment crosses the viewport
+        // on the map exactly when it does in degrees
+        bool CrossesArea(geo::Coordinates from, geo::Coordinates to, const geo::BoundingBox& area) {
+            const ClipBox box{ area.min.longitude, area.min.latitude, area.max.longitude, area.max.latitude };
+            svg::Point from_point{ from.longitude, from.latitude };
+            svg::Point to_point{ to.longitude, to.latitude };
+            bool from_clipped = false;
+            bool to_clipped = false;
+            return ClipSegment(from_point, to_point, box, from_clipped, to_clipped);
+        }
+
+        bool Intersects(const geo::BoundingBox& lhs, const geo::BoundingBox& rhs) {
+            return lhs.min.latitude <= rhs.max.latitude && rhs.min.latitude <= lhs.max.latitude
+                && lhs.min.longitude <= rhs.max.longitude && rhs.min.longitude <= lhs.max.longitude;
+        }
+
+        // Average Verdana glyph width relative to the font size
+        const double REGULAR_CHAR_WIDTH = 0.62;
+        const double BOLD_CHAR_WIDTH = 0.7;
+
+        struct LabelBox {
+            double left;
+            double top;
+            double right;
+            double bottom;
+
+            bool Intersects(const LabelBox& other) const {
+                return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+            }
+        };
+
+        // Text is drawn from its baseline, so the box spans one font size above the anchor
+        LabelBox EstimateLabelBox(svg::Point position, svg::Point offset, int font_size, std::string_view text, double char_width) {
+            const size_t char_count = std::count_if(text.begin(), text.end(),
+                [](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; });
+            const double left = position.x + offset.x;
+            const double bottom = position.y + offset.y;
+            return { left, bottom - font_size, left + char_count * font_size * char_width, bottom };
+        }
+
+        // Screen-space grid of placed label boxes
+        class LabelGrid {
+        public:
+            explicit LabelGrid(double cell_size)
+                : cell_size_(std::max(cell_size, 1.0)) {
+            }
+
+            // Places the box unless it overlaps one placed before
+            bool TryPlace(const LabelBox& box) {
+                const int min_x = ToCell(box.left);
+                const int max_x = ToCell(box.right);
+                const int min_y = ToCell(box.top);
+                const int max_y = ToCell(box.bottom);
+
+                for (int x = min_x; x <= max_x; ++x) {
+                    for (int y = min_y; y <= max_y; ++y) {
+                        auto it = cells_.find(MakeKey(x, y));
+                        if (it == cells_.end()) {
+                            continue;
+                        }
+                        for (size_t box_index : it->second) {
+                            if (boxes_[box_index].Intersects(box)) {
+                                return false;
+                            }
+                        }
+                    }
+                }
+
+                boxes_.push_back(box);
+                for (int x = min_x; x <= max_x; ++x) {
+                    for (int y = min_y; y <= max_y; ++y) {
+                        cells_[MakeKey(x, y)].push_back(boxes_.size() - 1);
+                    }
+                }
+                return true;
+            }
+
+        private:
+            int ToCell(double value) const {
+                return static_cast<int>(std::floor(value / cell_size_));
+            }
+
+            // Shifted as unsigned, negative cells included
+            static std::uint64_t MakeKey(int x, int y) {
+                return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y);
+            }
+
+            double cell_size_;
+            std::vector<LabelBox> boxes_;
+            std::unordered_map<std::uint64_t, std::vector<size_t>> cells_;
+        };
+
+    } // namespace
+
     bool IsZero(double value) {
         return std::abs(value) < EPSILON;
     }
 
-    svg::Document MapRenderer::RenderMap() const {
-        std::map<std::string_view, const transport::BusRoute*> sorted_bus = catalogue_.GetSortedBuses();
+    void SphereProjector::ProjectAll(const std::vector<double>& latitudes, const std::vector<double>& longitudes,
+        std::vector<double>& xs, std::vector<double>& ys) const {
+        const size_t count = latitudes.size();
+        xs.resize(count);
+        ys.resize(count);
+
+        // Plain indexed loops over separate arrays let the compiler emit packed SIMD arithmetic
+        const double* lat = latitudes.data();
+        const double* lon = longitudes.data();
+        double* x = xs.data();
+        double* y = ys.data();
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = (lon[i] - min_lon_) * zoom_coeff_ + padding_;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            y[i] = (max_lat_ - lat[i]) * zoom_coeff_ + padding_;
+        }
+    }
+
+    std::optional<geo::BoundingBox> ComputeBounds(const std::vector<double>& latitudes,
+        const std::vector<double>& longitudes, const std::vector<char>& mask) {
+        const double inf = std::numeric_limits<double>::infinity();
+        double min_lat = inf;
+        double max_lat = -inf;
+        double min_lon = inf;
+        double max_lon = -inf;
+
+        // Masked-out points are replaced by neutral values instead of branching,
+        // which keeps the min/max reductions vectorizable
+        for (size_t i = 0; i < latitudes.size(); ++i) {
+            const bool is_used = mask[i] != 0;
+            min_lat = std::min(min_lat, is_used ? latitudes[i] : inf);
+            max_lat = std::max(max_lat, is_used ? latitudes[i] : -inf);
+            min_lon = std::min(min_lon, is_used ? longitudes[i] : inf);
+            max_lon = std::max(max_lon, is_used ? longitudes[i] : -inf);
+        }
+
+        if (min_lat > max_lat) {
+            return std::nullopt;
+        }
+        return geo::BoundingBox{ { min_lat, min_lon }, { max_lat, max_lon } };
+    }
+
+    StopPositions::StopPositions(const SphereProjector& projector)
+        : projector_(projector) {
+    }
+
+    StopPositions::StopPositions(const SphereProjector& projector, const transport::TransportCatalogue& catalogue)
+        : projector_(projector) {
+        projector_.ProjectAll(catalogue.GetStopLatitudes(), catalogue.GetStopLongitudes(), xs_, ys_);
+    }
+
+    std::string MapRenderer::RenderMap() const {
+        MapLayers layers;
+        const StopPositions stop_positions = CreateFullMapLayers(layers);
+        return CreateSVGDocument(layers, stop_positions);
+    }
+
+    StopPositions MapRenderer::CreateFullMapLayers(MapLayers& layers) const {
+        const auto& latitudes = catalogue_.GetStopLatitudes();
+        const auto& longitudes = catalogue_.GetStopLongitudes();
+
         std::map<std::string_view, const transport::Stop*> sorted_stops;
-        for (const auto& [route_name, bus_route] : sorted_bus) {
+        std::vector<char> is_route_stop(latitudes.size(), 0);
+        size_t color_num = 0;
+        for (const auto& [route_name, bus_route] : catalogue_.GetSortedBuses()) {
+            if (bus_route->stops.empty()) {
+                continue;
+            }
+            layers.lines.push_back({ bus_route, color_num, 0, GetLinePointCount(*bus_route) });
+            AddBusLabels(layers, bus_route, color_num);
             for (const auto* stop : bus_route->stops) {
-                sorted_stops[stop->name] = stop;
+                if (!is_route_stop[stop->id]) {
+                    is_route_stop[stop->id] = 1;
+                    sorted_stops.emplace(stop->name, stop);
+                }
             }
+            color_num = (color_num + 1) % render_settings_.color_palette.size();
         }
 
-        return CreateSVGDocument(sorted_bus, sorted_stops);
-    }
+        layers.stops.reserve(sorted_stops.size());
+        for (const auto& [stop_name, stop] : sorted_stops) {
+            layers.stops.push_back(stop);
+        }
+        layers.stop_labels = layers.stops;
 
-    svg::Document MapRenderer::CreateSVGDocument(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const std::map<std::string_view, const transport::Stop*> sorted_stops) const {
-        svg::Document doc;
+        const auto bounds = ComputeBounds(latitudes, longitudes, is_route_stop);
+        const geo::Coordinates* no_points = nullptr;
+        const SphereProjector sphere_projector = bounds
+            ? SphereProjector(*bounds, render_settings_.width, render_settings_.height, render_settings_.padding)
+            : SphereProjector(no_points, no_points, render_settings_.width, render_settings_.height, render_settings_.padding);
 
-        std::vector<geo::Coordinates> route_stops_coords;
-        for (const auto& [bus_name, route] : sorted_bus) {
-            for (const auto& stop : route->stops) {
-                route_stops_coords.push_back(stop->coords);
+        StopPositions stop_positions(sphere_projector, catalogue_);
+        SetKeptPoints(layers, stop_positions);
+        CullOverlappingLabels(layers, stop_positions);
+
+        return stop_positions;
+    }
+
+    std::string MapRenderer::RenderMap(const geo::BoundingBox& viewport) const {
+        instrumentation::Span span("MapRenderer.RenderViewport");
+        std::map<std::string_view, const transport::Stop*> visible_stops;
+        for (const transport::Stop* stop : catalogue_.GetStopsInArea(viewport)) {
+            if (!catalogue_.GetBusesByStop(stop->name).empty()) {
+                visible_stops.emplace(stop->name, stop);
+            }
+        }
+        // A bus may pass through the viewport without a stop in it
+        std::map<std::string_view, const transport::BusRoute*> visible_buses;
+        for (const auto& [bus_route, bounds] : GetBusBounds()) {
+            if (Intersects(bounds, viewport)) {
+                visible_buses.emplace(bus_route->name, bus_route);
             }
         }
 
-        SphereProjector sphere_projector(route_stops_coords.begin(), route_stops_coords.end(),
-            render_settings_.width, render_settings_.height, render_settings_.padding);
+        MapLayers layers;
+        const auto& bus_colors = GetBusColors();
+        for (const auto& [route_name, bus_route] : visible_buses) {
+            const size_t color_num = bus_colors.at(bus_route);
+
+            // Consecutive segments crossing the viewport form one line, ClipLines cuts it to the canvas
+            const size_t point_count = GetLinePointCount(*bus_route);
+            size_t line_start = point_count;
+            for (size_t i = 0; i < point_count; ++i) {
+                const bool is_visible = i + 1 < point_count
+                    && CrossesArea(GetRoutePoint(*bus_route, i)->coords, GetRoutePoint(*bus_route, i + 1)->coords, viewport);
+                if (is_visible && line_start == point_count) {
+                    line_start = i;
+                }
+                else if (!is_visible && line_start != point_count) {
+                    layers.lines.push_back({ bus_route, color_num, line_start, i + 1 });
+                    line_start = point_count;
+                }
+            }
 
-        auto polylines = CreatePolylines(sorted_bus, sphere_projector);
-        for (const auto& polyline : polylines) {
-            doc.Add(polyline);
+            const size_t labels_begin = layers.labels.size();
+            AddBusLabels(layers, bus_route, color_num);
+            layers.labels.erase(std::remove_if(layers.labels.begin() + labels_begin, layers.labels.end(),
+                [&viewport](const BusLabel& label) { return !viewport.Contains(label.stop->coords); }),
+                layers.labels.end());
         }
 
-        auto route_names = CreateRouteNames(sorted_bus, sphere_projector);
-        for (const auto& route_name : route_names) {
-            doc.Add(route_name);
+        layers.stops.reserve(visible_stops.size());
+        for (const auto& [stop_name, stop] : visible_stops) {
+            layers.stops.push_back(stop);
         }
+        layers.stop_labels = layers.stops;
 
-        auto stop_symbols = CreateStopSymbols(sorted_stops, sphere_projector);
-        for (const auto& symbol : stop_symbols) {
-            doc.Add(symbol);
-        }
+        const geo::Coordinates corners[] = { viewport.min, viewport.max };
+        const StopPositions stop_positions(SphereProjector(std::begin(corners), std::end(corners),
+            render_settings_.width, render_settings_.height, render_settings_.padding));
+        SetKeptPoints(layers, stop_positions);
+        ClipLines(layers, stop_positions);
+        CullOverlappingLabels(layers, stop_positions);
 
-        auto stop_names = CreateStopsNames(sorted_stops, sphere_projector);
-        for (const auto& stop_name : stop_names) {
-            doc.Add(stop_name);
-        }
+        return CreateSVGDocument(layers, stop_positions);
+    }
 
-        return doc;
+    const std::string& MapRenderer::GetMapSvg() const {
+        std::lock_guard lock(map_svg_mutex_);
+        if (map_svg_version_ != catalogue_.GetVersion()) {
+            instrumentation::AddCount("map.cache_misses");
+            instrumentation::Span span("MapRenderer.RenderMap");
+            MapLayers layers;
+            map_stop_positions_ = CreateFullMapLayers(layers);
+            map_svg_ = CreateSVGDocument(layers, *map_stop_positions_);
+            map_svg_version_ = catalogue_.GetVersion();
+        }
+        else {
+            instrumentation::AddCount("map.cache_hits");
+        }
+        return map_svg_;
     }
 
-    std::vector<svg::Polyline> MapRenderer::CreatePolylines(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const SphereProjector& sphere_projector) const {
-        size_t color_num = 0;
-        std::vector<svg::Polyline> polylines;
-        for (const auto& [bus_name, route] : sorted_bus) {
-            if (route->stops.empty()) {
+    std::string MapRenderer::RenderRouteMap(const transport::Route& route) const {
+        using namespace std::literals;
+
+        // The overlay goes right before the closing tag of the cached base map
+        const std::string& base_map = GetMapSvg();
+        const std::string_view svg_end = "</svg>"sv;
+
+        std::string svg_text;
+        svg_text.reserve(base_map.size() + route.items.size() * 2 * SVG_ELEMENT_SIZE);
+        svg_text.append(base_map, 0, base_map.size() - svg_end.size());
+        svg::Writer writer(svg_text);
+
+        const auto& bus_colors = GetBusColors();
+        svg::PathAttrs underlayer;
+        underlayer.fill_color = &NONE_COLOR;
+        underlayer.stroke_color = &render_settings_.underlayer_color;
+        underlayer.stroke_width = render_settings_.line_width + 2 * render_settings_.underlayer_width;
+        underlayer.line_cap = svg::StrokeLineCap::ROUND;
+        underlayer.line_join = svg::StrokeLineJoin::ROUND;
+
+        for (const transport::RouteItem& item : route.items) {
+            if (!item.bus) {
                 continue;
             }
 
-            svg::Polyline polyline;
+            svg::PathAttrs line = underlayer;
+            line.stroke_color = &render_settings_.color_palette[bus_colors.at(item.bus)];
+            line.stroke_width = render_settings_.line_width;
 
-            std::vector<const transport::Stop*> route_stops{ route->stops.begin(), route->stops.end() };
-            if (route->is_circular == false) route_stops.insert(route_stops.end(), std::next(route->stops.rbegin()), route->stops.rend());
+            for (const svg::PathAttrs* attrs : { &underlayer, &line }) {
+                writer.StartPolyline();
+                for (const transport::Stop* stop : item.stops) {
+                    writer.AddPolylinePoint((*map_stop_positions_)(stop));
+                }
+                writer.EndPolyline(*attrs);
+            }
+        }
 
-            for (const auto& stop : route_stops) {
-                polyline.AddPoint(sphere_projector(stop->coords));
+        // Boarding and transfer stops
+        svg::PathAttrs stop_symbol;
+        stop_symbol.fill_color = &WHITE_COLOR;
+        stop_symbol.stroke_color = &BLACK_COLOR;
+        stop_symbol.stroke_width = render_settings_.underlayer_width;
+        const transport::Stop* last_drawn_stop = nullptr;
+        for (const transport::RouteItem& item : route.items) {
+            if (!item.bus) {
+                continue;
+            }
+            if (item.stops.front() != last_drawn_stop) {
+                writer.WriteCircle((*map_stop_positions_)(item.stops.front()), render_settings_.stop_radius, stop_symbol);
             }
+            writer.WriteCircle((*map_stop_positions_)(item.stops.back()), render_settings_.stop_radius, stop_symbol);
+            last_drawn_stop = item.stops.back();
+        }
 
-            polyline.SetStrokeColor(render_settings_.color_palette[color_num]);
-            polyline.SetFillColor("none");
-            polyline.SetStrokeWidth(render_settings_.line_width);
-            polyline.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-            polyline.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        writer.EndDocument();
+        return svg_text;
+    }
 
-            if (color_num < (render_settings_.color_palette.size() - 1)) {
-                ++color_num;
-            }
-            else {
-                color_num = 0;
+    const std::unordered_map<const transport::BusRoute*, size_t>& MapRenderer::GetBusColors() const {
+        std::lock_guard lock(bus_colors_mutex_);
+        if (bus_colors_version_ != catalogue_.GetVersion()) {
+            bus_colors_.clear();
+            size_t color_num = 0;
+            for (const auto& [route_name, bus_route] : catalogue_.GetSortedBuses()) {
+                if (bus_route->stops.empty()) {
+                    continue;
+                }
+                bus_colors_[bus_route] = color_num;
+                color_num = (color_num + 1) % render_settings_.color_palette.size();
             }
+            bus_colors_version_ = catalogue_.GetVersion();
+        }
+        return bus_colors_;
+    }
 
-            polylines.push_back(polyline);
+    const std::vector<std::pair<const transport::BusRoute*, geo::BoundingBox>>& MapRenderer::GetBusBounds() const {
+        std::lock_guard lock(bus_bounds_mutex_);
+        if (bus_bounds_version_ != catalogue_.GetVersion()) {
+            bus_bounds_.clear();
+            for (const auto& [bus_route, color_num] : GetBusColors()) {
+                geo::BoundingBox bounds{ bus_route->stops.front()->coords, bus_route->stops.front()->coords };
+                for (const transport::Stop* stop : bus_route->stops) {
+                    bounds.min.latitude = std::min(bounds.min.latitude, stop->coords.latitude);
+                    bounds.min.longitude = std::min(bounds.min.longitude, stop->coords.longitude);
+                    bounds.max.latitude = std::max(bounds.max.latitude, stop->coords.latitude);
+                    bounds.max.longitude = std::max(bounds.max.longitude, stop->coords.longitude);
+                }
+                bus_bounds_.emplace_back(bus_route, bounds);
+            }
+            bus_bounds_version_ = catalogue_.GetVersion();
         }
+        return bus_bounds_;
+    }
 
-        return polylines;
+    size_t MapRenderer::GetLinePointCount(const transport::BusRoute& route) const {
+        // A simplified linear route draws only the way there, the way back is the same line
+        if (render_settings_.simplify_tolerance > 0.0) {
+            return route.stops.size();
+        }
+        return GetRoutePointCount(route);
     }
 
-    std::vector<svg::Text> MapRenderer::CreateRouteNames(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const SphereProjector& sphere_projector) const {
-        std::vector<svg::Text> route_names;
-        size_t color_num = 0;
+    void MapRenderer::SetKeptPoints(MapLayers& layers, const StopPositions& stop_positions) const {
+        const double zoom = stop_positions.GetProjector().GetZoom();
+        if (render_settings_.simplify_tolerance <= 0.0 || zoom <= 0.0) {
+            return;
+        }
 
-        for (const auto& [bus_number, route] : sorted_bus) {
-            if (route->stops.empty()) {
-                continue;
+        std::lock_guard lock(simplified_routes_mutex_);
+        if (simplified_routes_version_ != catalogue_.GetVersion()) {
+            simplified_routes_.clear();
+            simplified_routes_version_ = catalogue_.GetVersion();
+        }
+
+        // Rounding the level up never lets the error exceed the tolerance in pixels
+        const int zoom_level = static_cast<int>(std::ceil(std::log2(zoom)));
+        const double tolerance = render_settings_.simplify_tolerance / std::exp2(zoom_level);
+        SimplifiedRoutes& simplified_routes = simplified_routes_[zoom_level];
+        // Only drawn routes are simplified, so a viewport costs as much as the buses it shows
+        for (BusLine& line : layers.lines) {
+            auto [it, inserted] = simplified_routes.try_emplace(line.route);
+            if (inserted) {
+                it->second = SimplifyRoute(*line.route, GetLinePointCount(*line.route), tolerance);
             }
+            line.kept_points = &it->second;
+        }
+    }
 
-            const auto& first_stop_coords = sphere_projector(route->stops[0]->coords);
-            AddRouteName(route_names, route, first_stop_coords, color_num);
+    void MapRenderer::ClipLines(MapLayers& layers, const StopPositions& stop_positions) const {
+        const double margin = render_settings_.line_width;
+        const ClipBox box{ -margin, -margin, render_settings_.width + margin, render_settings_.height + margin };
+
+        std::vector<BusLine> clipped_lines;
+        std::vector<svg::Point> points;
+        for (const BusLine& line : layers.lines) {
+            points.clear();
+            ForEachLinePoint(line, stop_positions, [&points](svg::Point point) { points.push_back(point); });
+
+            BusLine piece{ line.route, line.color_num, line.first, line.last };
+            const auto finish_piece = [&]() {
+                if (!piece.clipped_points.empty()) {
+                    clipped_lines.push_back(std::move(piece));
+                    piece.clipped_points.clear();
+                }
+            };
+            if (points.size() == 1 && box.Contains(points.front())) {
+                piece.clipped_points = points;
+            }
+            for (size_t i = 0; i + 1 < points.size(); ++i) {
+                svg::Point from = points[i];
+                svg::Point to = points[i + 1];
+                bool from_clipped = false;
+                bool to_clipped = false;
+                if (!ClipSegment(from, to, box, from_clipped, to_clipped)) {
+                    finish_piece();
+                    continue;
+                }
+                // A segment entering the box starts a new piece
+                if (from_clipped || piece.clipped_points.empty()) {
+                    finish_piece();
+                    piece.clipped_points.push_back(from);
+                }
+                piece.clipped_points.push_back(to);
+                if (to_clipped) {
+                    finish_piece();
+                }
+            }
+            finish_piece();
+        }
+        layers.lines = std::move(clipped_lines);
+    }
 
-            if (route->is_circular == false && route->stops[0] != route->stops[route->stops.size() - 1]) {
-                const auto& last_stop_coords = sphere_projector(route->stops[route->stops.size() - 1]->coords);
-                AddRouteName(route_names, route, last_stop_coords, color_num);
+    void MapRenderer::CullOverlappingLabels(MapLayers& layers, const StopPositions& stop_positions) const {
+        if (!render_settings_.cull_overlapping_labels) {
+            return;
+        }
+
+        // Bus labels are placed first and win over stop labels
+        LabelGrid grid(std::max(render_settings_.bus_label_font_size, render_settings_.stop_label_font_size) * 4.0);
+        layers.labels.erase(std::remove_if(layers.labels.begin(), layers.labels.end(),
+            [&](const BusLabel& label) {
+                return !grid.TryPlace(EstimateLabelBox(stop_positions(label.stop), render_settings_.bus_label_offset,
+                    render_settings_.bus_label_font_size, label.route->name, BOLD_CHAR_WIDTH));
+            }), layers.labels.end());
+        layers.stop_labels.erase(std::remove_if(layers.stop_labels.begin(), layers.stop_labels.end(),
+            [&](const transport::Stop* stop) {
+                return !grid.TryPlace(EstimateLabelBox(stop_positions(stop), render_settings_.stop_label_offset,
+                    render_settings_.stop_label_font_size, stop->name, REGULAR_CHAR_WIDTH));
+            }), layers.stop_labels.end());
+    }
+
+    void MapRenderer::AddBusLabels(MapLayers& layers, const transport::BusRoute* route, size_t color_num) const {
+        layers.labels.push_back({ route, route->stops[0], color_num });
+        if (route->is_circular == false && route->stops[0] != route->stops[route->stops.size() - 1]) {
+            layers.labels.push_back({ route, route->stops[route->stops.size() - 1], color_num });
+        }
+    }
+
+    std::vector<svg::StyleClass> MapRenderer::CreateStyleClasses() const {
+        svg::PathAttrs line;
+        line.fill_color = &NONE_COLOR;
+        line.stroke_width = render_settings_.line_width;
+        line.line_cap = svg::StrokeLineCap::ROUND;
+        line.line_join = svg::StrokeLineJoin::ROUND;
+
+        svg::PathAttrs underlayer;
+        underlayer.fill_color = &render_settings_.underlayer_color;
+        underlayer.stroke_color = &render_settings_.underlayer_color;
+        underlayer.stroke_width = render_settings_.underlayer_width;
+        underlayer.line_cap = svg::StrokeLineCap::ROUND;
+        underlayer.line_join = svg::StrokeLineJoin::ROUND;
+
+        const uint32_t bus_font_size = render_settings_.bus_label_font_size;
+        const uint32_t stop_font_size = render_settings_.stop_label_font_size;
+
+        std::vector<svg::StyleClass> classes;
+        for (size_t i = 0; i < render_settings_.color_palette.size(); ++i) {
+            line.stroke_color = &render_settings_.color_palette[i];
+            classes.push_back({ line_classes_[i], line, std::nullopt, {}, {} });
+        }
+        for (size_t i = 0; i < render_settings_.color_palette.size(); ++i) {
+            svg::PathAttrs label;
+            label.fill_color = &render_settings_.color_palette[i];
+            classes.push_back({ label_classes_[i], label, bus_font_size, "Verdana", "bold" });
+        }
+        classes.push_back({ std::string(BUS_UNDERLAYER_CLASS), underlayer, bus_font_size, "Verdana", "bold" });
+
+        svg::PathAttrs stop;
+        stop.fill_color = &WHITE_COLOR;
+        classes.push_back({ std::string(STOP_CLASS), stop, std::nullopt, {}, {} });
+        classes.push_back({ std::string(STOP_UNDERLAYER_CLASS), underlayer, stop_font_size, "Verdana", {} });
+
+        svg::PathAttrs stop_label;
+        stop_label.fill_color = &BLACK_COLOR;
+        classes.push_back({ std::string(STOP_LABEL_CLASS), stop_label, stop_font_size, "Verdana", {} });
+
+        return classes;
+    }
+
+    std::string MapRenderer::CreateSVGDocument(const MapLayers& layers, const StopPositions& stop_positions) const {
+        // Every chunk of every layer is rendered into its own buffer; the buffers are
+        // joined in layer order, so the result does not depend on thread scheduling
+        const auto line_chunks = SplitIntoChunks(layers.lines.size());
+        const auto label_chunks = SplitIntoChunks(layers.labels.size());
+        const auto stop_chunks = SplitIntoChunks(layers.stops.size());
+        const auto stop_label_chunks = SplitIntoChunks(layers.stop_labels.size());
+        const auto policy = (line_chunks.size() > 1 || label_chunks.size() > 1 || stop_chunks.size() > 1 || stop_label_chunks.size() > 1)
+            ? std::launch::async : std::launch::deferred;
+
+        std::vector<std::future<std::string>> parts;
+        auto render_part = [&](auto create_layer, const auto& items, size_t first, size_t last, size_t reserve) {
+            parts.push_back(std::async(policy, [this, create_layer, &items, first, last, reserve, &stop_positions] {
+                std::string part;
+                part.reserve(reserve);
+                svg::Writer writer(part);
+                (this->*create_layer)(writer, items, first, last, stop_positions);
+                return part;
+                }));
+        };
+
+        for (const auto& [first, last] : line_chunks) {
+            size_t point_count = 0;
+            for (size_t i = first; i < last; ++i) {
+                const BusLine& line = layers.lines[i];
+                point_count += line.clipped_points.empty() ? line.last - line.first : line.clipped_points.size();
             }
+            render_part(&MapRenderer::CreatePolylines, layers.lines, first, last,
+                point_count * SVG_POINT_SIZE + (last - first) * SVG_ELEMENT_SIZE);
+        }
+        for (const auto& [first, last] : label_chunks) {
+            render_part(&MapRenderer::CreateRouteNames, layers.labels, first, last, (last - first) * 2 * SVG_ELEMENT_SIZE);
+        }
+        for (const auto& [first, last] : stop_chunks) {
+            render_part(&MapRenderer::CreateStopSymbols, layers.stops, first, last, (last - first) * SVG_ELEMENT_SIZE);
+        }
+        for (const auto& [first, last] : stop_label_chunks) {
+            render_part(&MapRenderer::CreateStopsNames, layers.stop_labels, first, last, (last - first) * 2 * SVG_ELEMENT_SIZE);
+        }
 
-            color_num = (color_num + 1) % render_settings_.color_palette.size();
+        std::vector<std::string> rendered_parts;
+        rendered_parts.reserve(parts.size());
+        size_t total_size = SVG_ELEMENT_SIZE;
+        for (auto& part : parts) {
+            rendered_parts.push_back(part.get());
+            total_size += rendered_parts.back().size();
         }
 
-        return route_names;
+        std::string svg_text;
+        svg_text.reserve(total_size);
+        svg::Writer writer(svg_text);
+
+        writer.StartDocument();
+        if (render_settings_.use_style_classes) {
+            writer.WriteStyle(CreateStyleClasses());
+        }
+        for (const auto& part : rendered_parts) {
+            svg_text += part;
+        }
+        writer.EndDocument();
+
+        return svg_text;
     }
 
-    void MapRenderer::AddRouteName(std::vector<svg::Text>& route_names, const transport::BusRoute* route, const svg::Point& position, size_t& color_num) const {
-        svg::Text text;
-        svg::Text underlayer;
+    void MapRenderer::CreatePolylines(svg::Writer& writer, const std::vector<BusLine>& lines, size_t first, size_t last, const StopPositions& stop_positions) const {
+        for (size_t i = first; i < last; ++i) {
+            const BusLine& line = lines[i];
 
-        text.SetPosition(position);
-        text.SetOffset(render_settings_.bus_label_offset);
-        text.SetFontSize(render_settings_.bus_label_font_size);
-        text.SetFontFamily("Verdana");
-        text.SetFontWeight("bold");
-        text.SetData(route->name);
-        text.SetFillColor(render_settings_.color_palette[color_num]);
+            writer.StartPolyline();
+            ForEachLinePoint(line, stop_positions, [&writer](svg::Point point) { writer.AddPolylinePoint(point); });
 
-        underlayer.SetPosition(position);
-        underlayer.SetOffset(render_settings_.bus_label_offset);
-        underlayer.SetFontSize(render_settings_.bus_label_font_size);
-        underlayer.SetFontFamily("Verdana");
-        underlayer.SetFontWeight("bold");
-        underlayer.SetData(route->name);
-        underlayer.SetFillColor(render_settings_.underlayer_color);
-        underlayer.SetStrokeColor(render_settings_.underlayer_color);
-        underlayer.SetStrokeWidth(render_settings_.underlayer_width);
-        underlayer.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        underlayer.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+            if (render_settings_.use_style_classes) {
+                writer.EndPolyline(line_classes_[line.color_num]);
+                continue;
+            }
 
-        route_names.push_back(underlayer);
-        route_names.push_back(text);
+            svg::PathAttrs attrs;
+            attrs.fill_color = &NONE_COLOR;
+            attrs.stroke_color = &render_settings_.color_palette[line.color_num];
+            attrs.stroke_width = render_settings_.line_width;
+            attrs.line_cap = svg::StrokeLineCap::ROUND;
+            attrs.line_join = svg::StrokeLineJoin::ROUND;
+            writer.EndPolyline(attrs);
+        }
     }
 
-    std::vector<svg::Circle> MapRenderer::CreateStopSymbols(const std::map<std::string_view, const transport::Stop*>& sorted_stops, const SphereProjector& sphere_projector) const {
-        std::vector<svg::Circle> symbols;
-        for (const auto& [stop_name, stop] : sorted_stops) {
-            svg::Circle symbol;
-            symbol.SetCenter(sphere_projector(stop->coords));
-            symbol.SetRadius(render_settings_.stop_radius);
-            symbol.SetFillColor("white");
+    void MapRenderer::CreateRouteNames(svg::Writer& writer, const std::vector<BusLabel>& labels, size_t first, size_t last, const StopPositions& stop_positions) const {
+        svg::PathAttrs underlayer;
+        underlayer.fill_color = &render_settings_.underlayer_color;
+        underlayer.stroke_color = &render_settings_.underlayer_color;
+        underlayer.stroke_width = render_settings_.underlayer_width;
+        underlayer.line_cap = svg::StrokeLineCap::ROUND;
+        underlayer.line_join = svg::StrokeLineJoin::ROUND;
+
+        for (size_t i = first; i < last; ++i) {
+            const BusLabel& label = labels[i];
+            const svg::Point position = stop_positions(label.stop);
+
+            if (render_settings_.use_style_classes) {
+                writer.WriteText(position, render_settings_.bus_label_offset, label.route->name, BUS_UNDERLAYER_CLASS);
+                writer.WriteText(position, render_settings_.bus_label_offset, label.route->name, label_classes_[label.color_num]);
+                continue;
+            }
+
+            svg::PathAttrs text;
+            text.fill_color = &render_settings_.color_palette[label.color_num];
 
-            symbols.push_back(symbol);
+            writer.WriteText(position, render_settings_.bus_label_offset, render_settings_.bus_label_font_size,
+                "Verdana", "bold", label.route->name, underlayer);
+            writer.WriteText(position, render_settings_.bus_label_offset, render_settings_.bus_label_font_size,
+                "Verdana", "bold", label.route->name, text);
         }
+    }
+
+    void MapRenderer::CreateStopSymbols(svg::Writer& writer, const std::vector<const transport::Stop*>& stops, size_t first, size_t last, const StopPositions& stop_positions) const {
+        svg::PathAttrs symbol;
+        symbol.fill_color = &WHITE_COLOR;
 
-        return symbols;
+        for (size_t i = first; i < last; ++i) {
+            const transport::Stop* stop = stops[i];
+            if (render_settings_.use_style_classes) {
+                writer.WriteCircle(stop_positions(stop), render_settings_.stop_radius, STOP_CLASS);
+                continue;
+            }
+            writer.WriteCircle(stop_positions(stop), render_settings_.stop_radius, symbol);
+        }
     }
 
-    std::vector<svg::Text> MapRenderer::CreateStopsNames(const std::map<std::string_view, const transport::Stop*>& sorted_stops, const SphereProjector& sphere_projector) const {
-        std::vector<svg::Text> stop_names;
-        svg::Text text;
-        svg::Text underlayer;
-        for (const auto& [stop_name, stop] : sorted_stops) {
-            text.SetPosition(sphere_projector(stop->coords));
-            text.SetOffset(render_settings_.stop_label_offset);
-            text.SetFontSize(render_settings_.stop_label_font_size);
-            text.SetFontFamily("Verdana");
-            text.SetData(stop->name);
-            text.SetFillColor("black");
-
-            underlayer.SetPosition(sphere_projector(stop->coords));
-            underlayer.SetOffset(render_settings_.stop_label_offset);
-            underlayer.SetFontSize(render_settings_.stop_label_font_size);
-            underlayer.SetFontFamily("Verdana");
-            underlayer.SetData(stop->name);
-            underlayer.SetFillColor(render_settings_.underlayer_color);
-            underlayer.SetStrokeColor(render_settings_.underlayer_color);
-            underlayer.SetStrokeWidth(render_settings_.underlayer_width);
-            underlayer.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-            underlayer.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-            stop_names.push_back(underlayer);
-            stop_names.push_back(text);
-        }
-
-        return stop_names;
+    void MapRenderer::CreateStopsNames(svg::Writer& writer, const std::vector<const transport::Stop*>& stops, size_t first, size_t last, const StopPositions& stop_positions) const {
+        svg::PathAttrs underlayer;
+        underlayer.fill_color = &render_settings_.underlayer_color;
+        underlayer.stroke_color = &render_settings_.underlayer_color;
+        underlayer.stroke_width = render_settings_.underlayer_width;
+        underlayer.line_cap = svg::StrokeLineCap::ROUND;
+        underlayer.line_join = svg::StrokeLineJoin::ROUND;
+
+        svg::PathAttrs text;
+        text.fill_color = &BLACK_COLOR;
+
+        for (size_t i = first; i < last; ++i) {
+            const transport::Stop* stop = stops[i];
+            const svg::Point position = stop_positions(stop);
+            if (render_settings_.use_style_classes) {
+                writer.WriteText(position, render_settings_.stop_label_offset, stop->name, STOP_UNDERLAYER_CLASS);
+                writer.WriteText(position, render_settings_.stop_label_offset, stop->name, STOP_LABEL_CLASS);
+                continue;
+            }
+            writer.WriteText(position, render_settings_.stop_label_offset, render_settings_.stop_label_font_size,
+                "Verdana", {}, stop->name, underlayer);
+            writer.WriteText(position, render_settings_.stop_label_offset, render_settings_.stop_label_font_size,
+                "Verdana", {}, stop->name, text);
+        }
     }
 
 } // namespace map
\ No newline at end of file
@@ -3,11 +3,16 @@
 #include "svg.h"
 #include "domain.h"
 #include "transport_catalogue.h"
+#include "transport_router.h"
 
 #include <map>
+#include <mutex>
+#include <vector>
 #include <algorithm>
 #include <set>
+#include <optional>
 #include <string>
+#include <unordered_map>
 
 namespace map {
 
@@ -37,14 +42,44 @@ namespace map {
             const double min_lat = bottom_it->latitude;
             max_lat_ = top_it->latitude;
 
+            Fit({ { min_lat, min_lon_ }, { max_lat_, max_lon } }, max_width, max_height);
+        }
+
+        // Fits the rectangle into the image, e.g. bounds computed by ComputeBounds
+        SphereProjector(const geo::BoundingBox& bounds, double max_width, double max_height, double padding)
+            : padding_(padding)
+        {
+            Fit(bounds, max_width, max_height);
+        }
+
+        svg::Point operator()(geo::Coordinates coords) const {
+            return {
+                (coords.longitude - min_lon_) * zoom_coeff_ + padding_,
+                (max_lat_ - coords.latitude) * zoom_coeff_ + padding_
+            };
+        }
+
+        // Same formula as operator() over whole coordinate arrays, written so the loop vectorizes
+        void ProjectAll(const std::vector<double>& latitudes, const std::vector<double>& longitudes,
+            std::vector<double>& xs, std::vector<double>& ys) const;
+
+        double GetZoom() const {
+            return zoom_coeff_;
+        }
+
+    private:
+        void Fit(const geo::BoundingBox& bounds, double max_width, double max_height) {
+            min_lon_ = bounds.min.longitude;
+            max_lat_ = bounds.max.latitude;
+
             std::optional<double> width_zoom;
-            if (!IsZero(max_lon - min_lon_)) {
-                width_zoom = (max_width - 2 * padding) / (max_lon - min_lon_);
+            if (!IsZero(bounds.max.longitude - min_lon_)) {
+                width_zoom = (max_width - 2 * padding_) / (bounds.max.longitude - min_lon_);
             }
 
             std::optional<double> height_zoom;
-            if (!IsZero(max_lat_ - min_lat)) {
-                height_zoom = (max_height - 2 * padding) / (max_lat_ - min_lat);
+            if (!IsZero(max_lat_ - bounds.min.latitude)) {
+                height_zoom = (max_height - 2 * padding_) / (max_lat_ - bounds.min.latitude);
             }
 
             if (width_zoom && height_zoom) {
@@ -58,20 +93,40 @@ namespace map {
             }
         }
 
-        svg::Point operator()(geo::Coordinates coords) const {
-            return {
-                (coords.longitude - min_lon_) * zoom_coeff_ + padding_,
-                (max_lat_ - coords.latitude) * zoom_coeff_ + padding_
-            };
-        }
-
-    private:
         double padding_;
         double min_lon_ = 0;
         double max_lat_ = 0;
         double zoom_coeff_ = 0;
     };
 
+    // Bounds of the points whose mask entry is set, std::nullopt if there are none
+    std::optional<geo::BoundingBox> ComputeBounds(const std::vector<double>& latitudes,
+        const std::vector<double>& longitudes, const std::vector<char>& mask);
+
+    // Screen positions of stops: taken from arrays projected for every catalogue stop
+    // at once, or projected one by one when only a few stops are drawn
+    class StopPositions {
+    public:
+        explicit StopPositions(const SphereProjector& projector);
+        StopPositions(const SphereProjector& projector, const transport::TransportCatalogue& catalogue);
+
+        svg::Point operator()(const transport::Stop* stop) const {
+            if (xs_.empty()) {
+                return projector_(stop->coords);
+            }
+            return { xs_[stop->id], ys_[stop->id] };
+        }
+
+        const SphereProjector& GetProjector() const {
+            return projector_;
+        }
+
+    private:
+        SphereProjector projector_;
+        std::vector<double> xs_;
+        std::vector<double> ys_;
+    };
+
     struct RenderSettings {
         double width = 0.0;
         double height = 0.0;
@@ -85,6 +140,12 @@ namespace map {
         svg::Color underlayer_color = { svg::NoneColor };
         double underlayer_width = 0.0;
         std::vector<svg::Color> color_palette{};
+        // Douglas-Peucker tolerance in pixels for bus lines; 0 draws every stop
+        double simplify_tolerance = 0.0;
+        // Drop labels whose estimated box overlaps an already placed label
+        bool cull_overlapping_labels = false;
+        // Move repeated attributes into a <style> block and refer to them by class
+        bool use_style_classes = false;
     };
 
     class MapRenderer {
@@ -94,26 +155,99 @@ namespace map {
             : render_settings_(render_settings),
             catalogue_(catalogue)
         {
+            for (size_t i = 0; i < render_settings_.color_palette.size(); ++i) {
+                line_classes_.push_back("l" + std::to_string(i));
+                label_classes_.push_back("b" + std::to_string(i));
+            }
         }
 
-        svg::Document RenderMap() const;
+        std::string RenderMap() const;
+        // Renders only stops inside the viewport and bus segments crossing it,
+        // projected to fit the viewport instead of the whole network
+        std::string RenderMap(const geo::BoundingBox& viewport) const;
+        // Rendered once and reused until the catalogue version changes.
+        // The reference stays valid while the catalogue is not modified
+        const std::string& GetMapSvg() const;
+        // Cached base map with the buses and stops of the route drawn on top
+        std::string RenderRouteMap(const transport::Route& route) const;
 
     private:
 
+        // Piece of a bus line: points [first, last) of the route as it is driven,
+        // the way back included for non-roundtrip buses unless lines are simplified
+        struct BusLine {
+            const transport::BusRoute* route;
+            size_t color_num;
+            size_t first;
+            size_t last;
+            // Route points left by simplification, nullptr to draw all of them
+            const std::vector<size_t>* kept_points = nullptr;
+            // Screen points of a piece clipped to the canvas, drawn instead of the route points when set
+            std::vector<svg::Point> clipped_points{};
+        };
+
+        struct BusLabel {
+            const transport::BusRoute* route;
+            const transport::Stop* stop;
+            size_t color_num;
+        };
+
+        // Everything drawn on a map, each layer in output order
+        struct MapLayers {
+            std::vector<BusLine> lines;
+            std::vector<BusLabel> labels;
+            std::vector<const transport::Stop*> stops;
+            std::vector<const transport::Stop*> stop_labels;
+        };
+
         const RenderSettings render_settings_;
         const transport::TransportCatalogue& catalogue_;
-
-
-        svg::Document CreateSVGDocument(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const std::map<std::string_view, const transport::Stop*> sorted_stops) const;
-
-        std::vector<svg::Polyline> CreatePolylines(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const SphereProjector& sphere_projector) const;
-
-        std::vector<svg::Text> CreateRouteNames(const std::map<std::string_view, const transport::BusRoute*>& sorted_bus, const SphereProjector& sphere_projector) const;
-        void AddRouteName(std::vector<svg::Text>& route_names, const transport::BusRoute* route, const svg::Point& position, size_t& color_num) const;
-
-        std::vector<svg::Circle> CreateStopSymbols(const std::map<std::string_view, const transport::Stop*>& sorted_stops, const SphereProjector& sphere_projector) const;
-
-        std::vector<svg::Text> CreateStopsNames(const std::map<std::string_view, const transport::Stop*>& sorted_stops, const SphereProjector& sphere_projector) const;
+        // Style class names of bus lines and bus labels for each palette color
+        std::vector<std::string> line_classes_;
+        std::vector<std::string> label_classes_;
+
+        // Caches below are filled on first use; each has its own mutex so that
+        // concurrent requests may share one renderer
+        mutable std::mutex map_svg_mutex_;
+        mutable std::string map_svg_;
+        mutable std::optional<StopPositions> map_stop_positions_;
+        mutable std::optional<size_t> map_svg_version_;
+        // Palette index of every bus as on the full map, so clipped maps keep the same colors
+        mutable std::mutex bus_colors_mutex_;
+        mutable std::unordered_map<const transport::BusRoute*, size_t> bus_colors_;
+        mutable std::optional<size_t> bus_colors_version_;
+        // Bounding box of every drawn bus, so viewports find the buses passing through them
+        mutable std::mutex bus_bounds_mutex_;
+        mutable std::vector<std::pair<const transport::BusRoute*, geo::BoundingBox>> bus_bounds_;
+        mutable std::optional<size_t> bus_bounds_version_;
+
+        // Simplified bus lines per zoom level (log2 of the projector zoom, rounded up),
+        // each route simplified the first time it is drawn at that level
+        using SimplifiedRoutes = std::unordered_map<const transport::BusRoute*, std::vector<size_t>>;
+        mutable std::mutex simplified_routes_mutex_;
+        mutable std::map<int, SimplifiedRoutes> simplified_routes_;
+        mutable std::optional<size_t> simplified_routes_version_;
+
+        const std::unordered_map<const transport::BusRoute*, size_t>& GetBusColors() const;
+        const std::vector<std::pair<const transport::BusRoute*, geo::BoundingBox>>& GetBusBounds() const;
+        size_t GetLinePointCount(const transport::BusRoute& route) const;
+        void SetKeptPoints(MapLayers& layers, const StopPositions& stop_positions) const;
+        // Splits lines into pieces inside the canvas, grown by the line width for the stroke
+        void ClipLines(MapLayers& layers, const StopPositions& stop_positions) const;
+        void CullOverlappingLabels(MapLayers& layers, const StopPositions& stop_positions) const;
+        void AddBusLabels(MapLayers& layers, const transport::BusRoute* route, size_t color_num) const;
+
+        StopPositions CreateFullMapLayers(MapLayers& layers) const;
+        std::vector<svg::StyleClass> CreateStyleClasses() const;
+        std::string CreateSVGDocument(const MapLayers& layers, const StopPositions& stop_positions) const;
+
+        void CreatePolylines(svg::Writer& writer, const std::vector<BusLine>& lines, size_t first, size_t last, const StopPositions& stop_positions) const;
+
+        void CreateRouteNames(svg::Writer& writer, const std::vector<BusLabel>& labels, size_t first, size_t last, const StopPositions& stop_positions) const;
+
+        void CreateStopSymbols(svg::Writer& writer, const std::vector<const transport::Stop*>& stops, size_t first, size_t last, const StopPositions& stop_positions) const;
+
+        void CreateStopsNames(svg::Writer& writer, const std::vector<const transport::Stop*>& stops, size_t first, size_t last, const StopPositions& stop_positions) const;
 
     };
 
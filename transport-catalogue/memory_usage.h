@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace memory {
+
+    // Heap bytes held by standard containers, computed from their sizes and capacities
+    // with the node layout of libstdc++; allocator bookkeeping is not included
+
+    inline size_t StringBytes(const std::string& text) {
+        // Short strings live inside the object
+        return text.capacity() > std::string().capacity() ? text.capacity() + 1 : 0;
+    }
+
+    template <typename T>
+    size_t VectorBytes(const std::vector<T>& values) {
+        return values.capacity() * sizeof(T);
+    }
+
+    // Elements are kept in 512 byte blocks listed in a separate array of block pointers
+    template <typename T>
+    size_t DequeBytes(const std::deque<T>& values) {
+        const size_t block_size = sizeof(T) < 512 ? 512 / sizeof(T) : 1;
+        const size_t blocks = values.size() / block_size + 1;
+        return blocks * block_size * sizeof(T) + std::max<size_t>(blocks + 2, 8) * sizeof(T*);
+    }
+
+    // libstdc++ keeps the hash in the node unless hashing is fast and cannot throw; std::hash
+    // of strings counts as slow, that of pointers and integers as fast. Other libraries are
+    // assumed to keep it, which makes their numbers approximations
+    template <typename Key, typename Hash>
+    constexpr bool IsHashCached() {
+#ifdef __GLIBCXX__
+        return std::__cache_default<Key, Hash>::value;
+#else
+        return true;
+#endif
+    }
+
+    template <typename Value, bool cache_hash>
+    struct HashNode {
+        void* next;
+        Value value;
+        size_t hash;
+    };
+
+    template <typename Value>
+    struct HashNode<Value, false> {
+        void* next;
+        Value value;
+    };
+
+    // A bucket array plus one node per element: next pointer, element and maybe the hash.
+    // A single bucket is kept inside the map itself
+    template <typename HashMap>
+    size_t HashMapBytes(const HashMap& map) {
+        using Node = HashNode<typename HashMap::value_type, IsHashCached<typename HashMap::key_type, typename HashMap::hasher>()>;
+        const size_t bucket_bytes = map.bucket_count() > 1 ? map.bucket_count() * sizeof(void*) : 0;
+        return bucket_bytes + map.size() * sizeof(Node);
+    }
+
+    // One node per element: color, parent, left and right links, then the element
+    template <typename TreeMap>
+    size_t TreeMapBytes(const TreeMap& map) {
+        return map.size() * (4 * sizeof(void*) + sizeof(typename TreeMap::value_type));
+    }
+
+    // Capacity a vector reaches when grown to size by push_back from empty
+    inline size_t GrownCapacity(size_t size) {
+        size_t capacity = size > 0 ? 1 : 0;
+        while (capacity < size) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+} // namespace memory
\ No newline at end of file
@@ -1,69 +1,148 @@
 #include "request_handler.h"
 
+#include "instrumentation.h"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
 namespace request_handler {
 
-    json::Dict RequestHandler::ParseStopRequest(const transport::TransportCatalogue& catalogue, const json::Dict& request_map) {
-        json::Builder builder;
-        builder.StartDict()
-            .Key("request_id").Value(request_map.at("id").AsInt());
-
-        const std::string& stop_name = request_map.at("name").AsString();
-        if (catalogue.StopExists(stop_name)) {
-            if (const auto stop_info = catalogue.GetStopInfo(stop_name)) {
-                builder.Key("buses").StartArray();
-                for (const std::string& bus_name : stop_info->buses) {
-                    builder.Value(bus_name);
-                }
-                builder.EndArray();
+    namespace {
+
+        // Requests taken by a worker at a time: large enough to keep the shared
+        // counter cold, small enough to balance slow Map requests between workers
+        const size_t STAT_REQUEST_CHUNK = 64;
+
+        bool IsRouteRequest(const StatRequest& request) {
+            return std::holds_alternative<RouteStatRequest>(request) || std::holds_alternative<RouteMapStatRequest>(request);
+        }
+
+        // Bus names in name order
+        json::Node MakeStopResponse(int id, const std::vector<std::string>& bus_names) {
+            json::Builder builder;
+            builder.StartDict()
+                .Key("request_id").Value(id)
+                .Key("buses").StartArray();
+            for (const std::string& bus_name : bus_names) {
+                builder.Value(bus_name);
             }
+            builder.EndArray();
+            return builder.EndDict().Build();
         }
-        else {
-            builder.Key("error_message").Value("not found");
+
+        json::Node MakeBusResponse(int id, const transport::InfoRoute& bus_info) {
+            json::Builder builder;
+            builder.StartDict()
+                .Key("request_id").Value(id)
+                .Key("curvature").Value(bus_info.curvature)
+                .Key("route_length").Value(bus_info.length)
+                .Key("stop_count").Value(static_cast<int>(bus_info.stops_count))
+                .Key("unique_stop_count").Value(static_cast<int>(bus_info.unique_stops_count));
+            return builder.EndDict().Build();
         }
-        return builder.Build().AsMap();
-    }
 
-    json::Dict RequestHandler::ParseBusRequest(const transport::TransportCatalogue& catalogue, const json::Dict& request_map) {
-        json::Builder builder;
-        builder.StartDict()
-            .Key("request_id").Value(request_map.at("id").AsInt());
+        json::Node MakeNotFoundResponse(int id) {
+            json::Builder builder;
+            builder.StartDict()
+                .Key("request_id").Value(id)
+                .Key("error_message").Value("not found");
+            return builder.EndDict().Build();
+        }
 
-        const std::string& bus_name = request_map.at("name").AsString();
-        if (const auto bus_info = catalogue.GetBusInfo(bus_name)) {
-            builder.Key("curvature").Value(bus_info->curvature);
-            builder.Key("route_length").Value(bus_info->length);
-            builder.Key("stop_count").Value(static_cast<int>(bus_info->stops_count));
-            builder.Key("unique_stop_count").Value(static_cast<int>(bus_info->unique_stops_count));
+        // Prints responses as an indented array, the layout of PrintStatResponses
+        void PrintResponses(const std::vector<json::Node>& responses, std::ostream& out) {
+            using namespace std::literals;
+            const json::PrintContext context{ out, 4, 4 };
+            out << "[\n"sv;
+            for (size_t i = 0; i < responses.size(); ++i) {
+                if (i > 0) {
+                    out << ",\n"sv;
+                }
+                context.PrintIndent();
+                json::PrintNode(responses[i], context);
+            }
+            out << "\n]"sv;
         }
-        else {
-            builder.Key("error_message").Value("not found");
+
+    } // namespace
+
+    bool NeedsRouter(const std::vector<StatRequest>& stat_requests) {
+        return std::any_of(stat_requests.begin(), stat_requests.end(), IsRouteRequest);
+    }
+
+    size_t CountRouteRequests(const std::vector<StatRequest>& stat_requests) {
+        return static_cast<size_t>(std::count_if(stat_requests.begin(), stat_requests.end(), IsRouteRequest));
+    }
+
+    void PrintSnapshotResponses(const transport::CatalogueView& view, const std::vector<SnapshotStatRequest>& stat_requests, std::ostream& out) {
+        instrumentation::Span span("PrintSnapshotResponses");
+        std::vector<json::Node> responses;
+        responses.reserve(stat_requests.size());
+        for (const SnapshotStatRequest& request : stat_requests) {
+            if (const auto* stop_request = std::get_if<SnapshotStopRequest>(&request)) {
+                if (!stop_request->stop) {
+                    responses.push_back(MakeNotFoundResponse(stop_request->id));
+                    continue;
+                }
+                std::vector<std::string> bus_names;
+                for (const transport::CatalogueView::BusId bus : view.GetStopBuses(*stop_request->stop)) {
+                    bus_names.emplace_back(view.GetBusName(bus));
+                }
+                responses.push_back(MakeStopResponse(stop_request->id, bus_names));
+            }
+            else {
+                const auto& bus_request = std::get<SnapshotBusRequest>(request);
+                responses.push_back(bus_request.bus ? MakeBusResponse(bus_request.id, view.GetBusInfo(*bus_request.bus))
+                    : MakeNotFoundResponse(bus_request.id));
+            }
         }
-        return builder.Build().AsMap();
+        PrintResponses(responses, out);
     }
 
-    json::Dict RequestHandler::ParseMapRequest(const json::Dict& request_map, map::MapRenderer& map_renderer) {
-        json::Builder builder;
-        builder.StartDict()
-            .Key("request_id").Value(request_map.at("id").AsInt());
+    RequestHandler::RequestHandler(const transport::TransportCatalogue& catalogue, const map::RenderSettings& render_settings, transport::Router routing_settings)
+        : catalogue_(catalogue)
+        , render_settings_(render_settings)
+        , routing_settings_(std::move(routing_settings)) {
+    }
+
+    json::Node RequestHandler::ProcessStopRequest(const transport::TransportCatalogue& catalogue, const StopStatRequest& request) {
+        if (!request.stop) {
+            return MakeNotFoundResponse(request.id);
+        }
+        return MakeStopResponse(request.id, catalogue.GetStopInfo(request.stop).buses);
+    }
 
-        std::ostringstream svg_stream;
-        svg::Document map = map_renderer.RenderMap();
-        map.Render(svg_stream);
+    json::Node RequestHandler::ProcessBusRequest(const transport::TransportCatalogue& catalogue, const BusStatRequest& request) {
+        if (!request.bus) {
+            return MakeNotFoundResponse(request.id);
+        }
+        return MakeBusResponse(request.id, catalogue.GetBusInfo(request.bus));
+    }
 
-        builder.Key("map").Value(svg_stream.str());
+    json::Node RequestHandler::ProcessMapRequest(const MapStatRequest& request, map::MapRenderer& map_renderer) {
+        // Built directly so the cached SVG is copied only once into the response
+        json::Dict response;
+        response["request_id"] = request.id;
+        if (request.viewport) {
+            response["map"] = map_renderer.RenderMap(*request.viewport);
+        }
+        else {
+            response["map"] = map_renderer.GetMapSvg();
+        }
 
-        return builder.Build().AsMap();
+        return json::Node{ std::move(response) };
     }
 
-    json::Dict RequestHandler::ParseRouterRequest(const json::Dict& stat_requests, const transport::Router& router) {
+    json::Node RequestHandler::ProcessRouteRequest(const RouteStatRequest& request, const transport::Router& router) {
         json::Builder builder;
         builder.StartDict()
-            .Key("request_id").Value(stat_requests.at("id").AsInt());
-
-        const std::string_view stop_from = stat_requests.at("from").AsString();
-        const std::string_view stop_to = stat_requests.at("to").AsString();
+            .Key("request_id").Value(request.id);
 
-        const auto routing = router.FindRoute(stop_from, stop_to);
+        std::optional<transport::Route> routing;
+        if (request.from && request.to) {
+            routing = router.FindRoute(request.from, request.to);
+        }
 
         if (!routing) {
             builder.Key("error_message").Value("not found");
@@ -90,30 +169,194 @@ namespace request_handler {
             builder.Key("items").Value(items);
         }
 
-        return builder.Build().AsMap();
+        return builder.Build();
     }
 
-    json::Array RequestHandler::ParseStatRequests(const transport::TransportCatalogue& catalogue, const json::Array& stat_requests, map::MapRenderer& map_renderer, const transport::Router& router) {
+    json::Node RequestHandler::ProcessRouteMapRequest(const RouteMapStatRequest& request, map::MapRenderer& map_renderer, const transport::Router& router) {
+        json::Dict response;
+        response["request_id"] = request.id;
+
+        std::optional<transport::Route> routing;
+        if (request.from && request.to) {
+            routing = router.FindRoute(request.from, request.to);
+        }
+
+        if (!routing) {
+            response["error_message"] = "not found";
+        }
+        else {
+            response["map"] = map_renderer.RenderRouteMap(*routing);
+        }
+
+        return json::Node{ std::move(response) };
+    }
+
+    json::Node RequestHandler::ProcessNearbyRequest(const transport::TransportCatalogue& catalogue, const NearbyStatRequest& request) {
+        std::vector<transport::NearbyStop> stops;
+        if (request.count) {
+            stops = catalogue.GetNearestStops(request.center, *request.count);
+            if (request.radius) {
+                const double radius = *request.radius;
+                stops.erase(std::find_if(stops.begin(), stops.end(),
+                    [radius](const transport::NearbyStop& stop) { return stop.distance > radius; }), stops.end());
+            }
+        }
+        else if (request.radius) {
+            stops = catalogue.GetStopsInRadius(request.center, *request.radius);
+        }
+
         json::Builder builder;
-        builder.StartArray();
-        for (const auto& request : stat_requests) {
-            const auto& request_map = request.AsMap();
-            const auto& type = request_map.at("type").AsString();
-            if (type == "Stop") {
-                builder.Value(ParseStopRequest(catalogue, request_map));
+        builder.StartDict()
+            .Key("request_id").Value(request.id)
+            .Key("stops").StartArray();
+        for (const auto& [stop, distance] : stops) {
+            builder.StartDict()
+                .Key("name").Value(stop->name)
+                .Key("distance").Value(distance)
+                .EndDict();
+        }
+        builder.EndArray();
+        return builder.EndDict().Build();
+    }
+
+    json::Node RequestHandler::ProcessStatRequest(const StatRequest& request) {
+        return std::visit([&](const auto& typed_request) {
+            using RequestType = std::decay_t<decltype(typed_request)>;
+            if constexpr (std::is_same_v<RequestType, StopStatRequest>) {
+                instrumentation::Span span("request.Stop");
+                return ProcessStopRequest(catalogue_, typed_request);
+            }
+            else if constexpr (std::is_same_v<RequestType, BusStatRequest>) {
+                instrumentation::Span span("request.Bus");
+                return ProcessBusRequest(catalogue_, typed_request);
             }
-            else if (type == "Bus") {
-                builder.Value(ParseBusRequest(catalogue, request_map));
+            else if constexpr (std::is_same_v<RequestType, MapStatRequest>) {
+                instrumentation::Span span("request.Map");
+                return ProcessMapRequest(typed_request, GetMapRenderer());
             }
-            else if (type == "Map") {
-                builder.Value(ParseMapRequest(request_map, map_renderer));
+            else if constexpr (std::is_same_v<RequestType, RouteStatRequest>) {
+                instrumentation::Span span("request.Route");
+                return ProcessRouteRequest(typed_request, GetRouter());
             }
-            else if (type == "Route") {
-                builder.Value(ParseRouterRequest(request_map, router));
+            else if constexpr (std::is_same_v<RequestType, RouteMapStatRequest>) {
+                instrumentation::Span span("request.RouteMap");
+                return ProcessRouteMapRequest(typed_request, GetMapRenderer(), GetRouter());
             }
+            else if constexpr (std::is_same_v<RequestType, NearbyStatRequest>) {
+                instrumentation::Span span("request.Nearby");
+                return ProcessNearbyRequest(catalogue_, typed_request);
+            }
+            }, request);
+    }
+
+    json::Array RequestHandler::ProcessStatRequests(const std::vector<StatRequest>& stat_requests) {
+        json::Array responses;
+        responses.reserve(stat_requests.size());
+        for (const auto& request : stat_requests) {
+            responses.emplace_back(ProcessStatRequest(request));
         }
-        builder.EndArray();
-        return builder.Build().AsArray();
+        return responses;
+    }
+
+    void RequestHandler::PrintStatResponses(const std::vector<StatRequest>& stat_requests, std::ostream& out, size_t thread_count) {
+        using namespace std::literals;
+
+        // Every chunk is printed into its own buffer, the buffers are written out in order
+        const size_t chunk_count = (stat_requests.size() + STAT_REQUEST_CHUNK - 1) / STAT_REQUEST_CHUNK;
+        std::vector<std::string> buffers(chunk_count);
+        // An exception leaving a worker thread would terminate the process, so it is kept with its chunk
+        std::vector<std::exception_ptr> errors(chunk_count);
+        std::atomic<size_t> next_chunk = 0;
+
+        // Idle workers take the next unanswered chunk, so slow requests do not stall the others
+        const auto answer_chunks = [&]() {
+            for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+                try {
+                    std::ostringstream buffer;
+                    const json::PrintContext context{ buffer, 4, 4 };
+                    const size_t first = chunk * STAT_REQUEST_CHUNK;
+                    const size_t last = std::min(first + STAT_REQUEST_CHUNK, stat_requests.size());
+                    for (size_t i = first; i < last; ++i) {
+                        if (i > 0) {
+                            buffer << ",\n"sv;
+                        }
+                        context.PrintIndent();
+                        json::PrintNode(ProcessStatRequest(stat_requests[i]), context);
+                    }
+                    buffers[chunk] = buffer.str();
+                }
+                catch (...) {
+                    errors[chunk] = std::current_exception();
+                    // Chunks before this one are taken already and still finish
+                    next_chunk = chunk_count;
+                }
+            }
+        };
+
+        if (thread_count == 0) {
+            thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        thread_count = std::min(thread_count, chunk_count);
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < thread_count; ++i) {
+            workers.emplace_back(answer_chunks);
+        }
+        answer_chunks();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        // The first failing request in order, as if answered on one thread
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        instrumentation::Span span("PrintStatResponses.Write");
+        out << "[\n"sv;
+        for (const std::string& buffer : buffers) {
+            out << buffer;
+            instrumentation::AddCount("output.bytes", buffer.size());
+        }
+        out << "\n]"sv;
+    }
+
+    map::MapRenderer& RequestHandler::GetMapRenderer() {
+        std::call_once(map_renderer_flag_, [this]() {
+            map_renderer_ = std::make_unique<map::MapRenderer>(render_settings_, catalogue_);
+            });
+        return *map_renderer_;
+    }
+
+    void RequestHandler::PrecomputeRouter() {
+        if (router_build_.valid()) {
+            return;
+        }
+        router_build_ = std::async(std::launch::async, [this]() {
+            return std::make_unique<transport::Router>(routing_settings_, catalogue_);
+            });
+    }
+
+    const transport::Router& RequestHandler::GetRouter() {
+        std::call_once(*router_flag_, [this]() {
+            router_ = router_build_.valid() ? router_build_.get()
+                : std::make_unique<transport::Router>(routing_settings_, catalogue_);
+            });
+        return *router_;
+    }
+
+    void RequestHandler::ResetRouter() {
+        if (router_build_.valid()) {
+            router_build_.wait();
+        }
+        router_build_ = {};
+        router_.reset();
+        router_flag_.emplace();
+    }
+
+    const transport::Router& RequestHandler::GetRoutingSettings() const {
+        return routing_settings_;
     }
 
 } // namespace request_handler
\ No newline at end of file
@@ -1,28 +1,129 @@
 #pragma once
 
 #include "transport_catalogue.h"
+#include "catalogue_snapshot.h"
 #include "transport_router.h"
 #include "json.h"
 #include "domain.h"
 #include "map_renderer.h"
 #include "json_builder.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
 #include <sstream>
+#include <variant>
 
 
 namespace request_handler {
 
+	struct StopStatRequest {
+		int id;
+		const transport::Stop* stop;
+	};
+
+	struct BusStatRequest {
+		int id;
+		const transport::BusRoute* bus;
+	};
+
+	struct MapStatRequest {
+		int id;
+		// Only this area is rendered when set
+		std::optional<geo::BoundingBox> viewport;
+	};
+
+	struct RouteStatRequest {
+		int id;
+		const transport::Stop* from;
+		const transport::Stop* to;
+	};
+
+	// Map with the fastest route between two stops drawn on top
+	struct RouteMapStatRequest {
+		int id;
+		const transport::Stop* from;
+		const transport::Stop* to;
+	};
+
+	// Stops around a point: the count nearest ones, those within radius meters, or both
+	struct NearbyStatRequest {
+		int id;
+		geo::Coordinates center;
+		std::optional<double> radius;
+		std::optional<size_t> count;
+	};
+
+	// Stops and buses are resolved once while decoding; nullptr means the name is unknown
+	using StatRequest = std::variant<StopStatRequest, BusStatRequest, MapStatRequest, RouteStatRequest, RouteMapStatRequest, NearbyStatRequest>;
+
+	// Requests a catalogue snapshot answers by itself, resolved in its view; std::nullopt means the name is unknown
+	struct SnapshotStopRequest {
+		int id;
+		std::optional<transport::CatalogueView::StopId> stop;
+	};
+
+	struct SnapshotBusRequest {
+		int id;
+		std::optional<transport::CatalogueView::BusId> bus;
+	};
+
+	using SnapshotStatRequest = std::variant<SnapshotStopRequest, SnapshotBusRequest>;
+
+	// Answers straight from the view, printed byte for byte as RequestHandler prints the same
+	// requests over the catalogue loaded from it
+	void PrintSnapshotResponses(const transport::CatalogueView& view, const std::vector<SnapshotStatRequest>& stat_requests, std::ostream& out);
+
+	// True if any of the requests needs the router
+	bool NeedsRouter(const std::vector<StatRequest>& stat_requests);
+	// Route and RouteMap requests
+	size_t CountRouteRequests(const std::vector<StatRequest>& stat_requests);
+
 	class RequestHandler {
 
 	public:
-		RequestHandler(const map::MapRenderer& map_renderer) : map_renderer_(map_renderer) {}
-		json::Dict ParseStopRequest(const transport::TransportCatalogue& catalogue, const json::Dict& request_map);
-		json::Dict ParseBusRequest(const transport::TransportCatalogue& catalogue, const json::Dict& request_map);
-		json::Dict ParseMapRequest(const json::Dict& request_map, map::MapRenderer& map_renderer);
-		json::Dict ParseRouterRequest(const json::Dict& stat_requests, const transport::Router& router);
-		json::Array ParseStatRequests(const transport::TransportCatalogue& catalogue, const json::Array& stat_requests, map::MapRenderer& map_renderer, const transport::Router& router);
+		// The router and the renderer are built on the first request that needs them,
+		// so batches of Stop and Bus requests never pay for the routing precompute
+		RequestHandler(const transport::TransportCatalogue& catalogue, const map::RenderSettings& render_settings, transport::Router routing_settings);
+
+		json::Node ProcessStopRequest(const transport::TransportCatalogue& catalogue, const StopStatRequest& request);
+		json::Node ProcessBusRequest(const transport::TransportCatalogue& catalogue, const BusStatRequest& request);
+		json::Node ProcessMapRequest(const MapStatRequest& request, map::MapRenderer& map_renderer);
+		json::Node ProcessRouteRequest(const RouteStatRequest& request, const transport::Router& router);
+		json::Node ProcessNearbyRequest(const transport::TransportCatalogue& catalogue, const NearbyStatRequest& request);
+		json::Node ProcessRouteMapRequest(const RouteMapStatRequest& request, map::MapRenderer& map_renderer, const transport::Router& router);
+		json::Node ProcessStatRequest(const StatRequest& request);
+		json::Array ProcessStatRequests(const std::vector<StatRequest>& stat_requests);
+		// Answers the requests on thread_count threads (0 means one per core) and prints the array
+		// of responses in request order, byte for byte as json::Print prints ProcessStatRequests
+		void PrintStatResponses(const std::vector<StatRequest>& stat_requests, std::ostream& out, size_t thread_count = 1);
+
+		// Starts building the router on a background thread, so requests answered meanwhile
+		// overlap with the precompute and the first Route request waits only for what is left
+		void PrecomputeRouter();
+
+		// Safe to call from several threads, only the first call builds
+		map::MapRenderer& GetMapRenderer();
+		const transport::Router& GetRouter();
+
+		// Waits for a router being built and drops it, so the catalogue may be modified.
+		// Not safe while requests are answered; the renderer notices changes by itself
+		void ResetRouter();
+		// The settings the router is built with, unbuilt
+		const transport::Router& GetRoutingSettings() const;
+
 	private:
+		const transport::TransportCatalogue& catalogue_;
+		const map::RenderSettings render_settings_;
+		const transport::Router routing_settings_;
 
-		map::MapRenderer map_renderer_;
+		std::once_flag map_renderer_flag_;
+		std::unique_ptr<map::MapRenderer> map_renderer_;
+		// Emplaced anew when the router is reset
+		std::optional<std::once_flag> router_flag_{ std::in_place };
+		std::unique_ptr<transport::Router> router_;
+		std::future<std::unique_ptr<transport::Router>> router_build_;
 	};
 
 } // namespace request_handler
\ No newline at end of file
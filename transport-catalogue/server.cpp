@@ -0,0 +1,275 @@
+#include "server.h"
+
+#include "instrumentation.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <streambuf>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define TC_HAS_UNIX_SOCKETS
+#endif
+
+namespace server {
+
+    namespace {
+
+        // Skips whitespace between documents, false at the end of input
+        bool HasDocument(std::istream& in) {
+            in >> std::ws;
+            return in.peek() != std::char_traits<char>::eof();
+        }
+
+        void PrintError(const std::string& message, std::ostream& out) {
+            json::Dict error;
+            error["error_message"] = message;
+            json::Print(json::Document{ json::Node{ std::move(error) } }, out);
+            out << std::endl;
+        }
+
+        // The router reads the catalogue, so it is dropped before the patch and rebuilt in the background after.
+        // A patch the router could not fit in the memory budget is undone, the error goes to the client
+        void ApplyPatch(const json::Array& patch_requests, const Services& services) {
+            services.request_handler.ResetRouter();
+            services.catalogue.StartChanges();
+            try {
+                json_reader::ParsePatchRequests(services.catalogue, patch_requests);
+                transport::CheckRouterMemory(services.request_handler.GetRoutingSettings(), services.catalogue);
+            }
+            catch (...) {
+                services.catalogue.UndoChanges();
+                services.request_handler.PrecomputeRouter();
+                throw;
+            }
+            services.catalogue.FinishChanges();
+            services.request_handler.PrecomputeRouter();
+        }
+
+#ifdef TC_HAS_UNIX_SOCKETS
+
+        std::runtime_error SystemError(const std::string& what) {
+            return std::runtime_error(what + ": " + std::strerror(errno));
+        }
+
+        // Buffered stream over a connected socket. The last character read stays
+        // in the buffer after a refill, so json::Load can put it back
+        class SocketStreamBuf : public std::streambuf {
+        public:
+            explicit SocketStreamBuf(int fd)
+                : fd_(fd) {
+                setg(input_, input_, input_);
+                setp(output_, output_ + sizeof(output_));
+            }
+
+        protected:
+            int_type underflow() override {
+                size_t kept = 0;
+                if (gptr() > eback()) {
+                    input_[0] = gptr()[-1];
+                    kept = 1;
+                }
+
+                ssize_t size = 0;
+                do {
+                    size = ::read(fd_, input_ + kept, sizeof(input_) - kept);
+                } while (size < 0 && errno == EINTR);
+                if (size <= 0) {
+                    return traits_type::eof();
+                }
+
+                setg(input_, input_ + kept, input_ + kept + size);
+                return traits_type::to_int_type(*gptr());
+            }
+
+            int_type overflow(int_type ch) override {
+                if (!Flush()) {
+                    return traits_type::eof();
+                }
+                if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                    *pptr() = traits_type::to_char_type(ch);
+                    pbump(1);
+                }
+                return traits_type::not_eof(ch);
+            }
+
+            int sync() override {
+                return Flush() ? 0 : -1;
+            }
+
+        private:
+            bool Flush() {
+                for (const char* data = pbase(); data < pptr();) {
+                    const ssize_t written = ::write(fd_, data, pptr() - data);
+                    if (written < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (written <= 0) {
+                        return false;
+                    }
+                    data += written;
+                }
+                setp(output_, output_ + sizeof(output_));
+                return true;
+            }
+
+            int fd_;
+            char input_[4096];
+            char output_[4096];
+        };
+
+        // Closes the descriptor when leaving the scope
+        class Socket {
+        public:
+            explicit Socket(int fd)
+                : fd_(fd) {
+            }
+
+            Socket(const Socket&) = delete;
+            Socket& operator=(const Socket&) = delete;
+
+            ~Socket() {
+                if (fd_ >= 0) {
+                    ::close(fd_);
+                }
+            }
+
+            int Get() const {
+                return fd_;
+            }
+
+        private:
+            int fd_;
+        };
+
+        sockaddr_un MakeAddress(const std::string& path) {
+            sockaddr_un address{};
+            if (path.size() >= sizeof(address.sun_path)) {
+                throw std::runtime_error("Socket path is too long: " + path);
+            }
+            address.sun_family = AF_UNIX;
+            std::strcpy(address.sun_path, path.c_str());
+            return address;
+        }
+
+#endif
+
+    } // namespace
+
+    void AnswerBatch(const json::Node& batch, const Services& services, std::ostream& out) {
+        instrumentation::Span span("server.Batch");
+        try {
+            if (batch.IsMap() && batch.AsMap().count("patch_requests")) {
+                const json::Array& patch_requests = batch.AsMap().at("patch_requests").AsArray();
+                ApplyPatch(patch_requests, services);
+                if (!batch.AsMap().count("stat_requests")) {
+                    json::Dict applied;
+                    applied["applied_requests"] = static_cast<int>(patch_requests.size());
+                    json::Print(json::Document{ json::Node{ std::move(applied) } }, out);
+                    out << std::endl;
+                    return;
+                }
+            }
+            const json::Array& requests = batch.IsArray() ? batch.AsArray() : batch.AsMap().at("stat_requests").AsArray();
+            const auto stat_requests = json_reader::ParseStatRequests(services.catalogue, requests);
+            // Responses are printed only once all are answered, so a failed one leaves nothing half written
+            services.request_handler.PrintStatResponses(stat_requests, out, services.thread_count);
+            out << std::endl;
+        }
+        catch (const std::exception& e) {
+            PrintError(e.what(), out);
+        }
+    }
+
+    void ServeStream(std::istream& in, std::ostream& out, const Services& services) {
+        while (HasDocument(in)) {
+            json::Document batch{ nullptr };
+            try {
+                batch = json::Load(in);
+            }
+            catch (const json::ParsingError& e) {
+                // The rest of the input can not be split into documents any more
+                PrintError(e.what(), out);
+                return;
+            }
+            AnswerBatch(batch.GetRoot(), services, out);
+        }
+    }
+
+#ifdef TC_HAS_UNIX_SOCKETS
+
+    void ServeSocket(const std::string& path, const Services& services) {
+        const sockaddr_un address = MakeAddress(path);
+        const Socket listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (listener.Get() < 0) {
+            throw SystemError("socket");
+        }
+
+        // A client leaving early must end its connection, not the server
+        std::signal(SIGPIPE, SIG_IGN);
+        ::unlink(path.c_str());
+        if (::bind(listener.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            throw SystemError("bind " + path);
+        }
+        if (::listen(listener.Get(), SOMAXCONN) < 0) {
+            throw SystemError("listen " + path);
+        }
+
+        while (true) {
+            const Socket connection(::accept(listener.Get(), nullptr, nullptr));
+            if (connection.Get() < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw SystemError("accept");
+            }
+
+            SocketStreamBuf buffer(connection.Get());
+            std::iostream stream(&buffer);
+            ServeStream(stream, stream, services);
+            stream.flush();
+        }
+    }
+
+    void RunClient(const std::string& path, std::istream& in, std::ostream& out) {
+        const sockaddr_un address = MakeAddress(path);
+        const Socket connection(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (connection.Get() < 0) {
+            throw SystemError("socket");
+        }
+        if (::connect(connection.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            throw SystemError("connect " + path);
+        }
+
+        SocketStreamBuf buffer(connection.Get());
+        std::iostream stream(&buffer);
+        while (HasDocument(in)) {
+            json::Print(json::Load(in), stream);
+            stream << std::endl;
+
+            if (!HasDocument(stream)) {
+                throw std::runtime_error("Server closed the connection");
+            }
+            json::Print(json::Load(stream), out);
+            out << std::endl;
+        }
+    }
+
+#else
+
+    void ServeSocket(const std::string& path, const Services&) {
+        throw std::runtime_error("Unix domain sockets are not supported on this platform: " + path);
+    }
+
+    void RunClient(const std::string& path, std::istream&, std::ostream&) {
+        throw std::runtime_error("Unix domain sockets are not supported on this platform: " + path);
+    }
+
+#endif
+
+} // namespace server
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "json.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace server {
+
+    // Subsystems built once from the base document and shared by every batch
+    struct Services {
+        transport::TransportCatalogue& catalogue;
+        request_handler::RequestHandler& request_handler;
+        size_t thread_count = 1;
+    };
+
+    // Answers one stat request document, either {"stat_requests": [...]} or the bare array,
+    // with the response array and a newline. A malformed batch, or one a request of which fails,
+    // gets {"error_message": ...} and the server goes on.
+    // "patch_requests" in the document are applied first; without stat requests
+    // the answer is {"applied_requests": N}
+    void AnswerBatch(const json::Node& batch, const Services& services, std::ostream& out);
+
+    // Answers stat request documents read one after another until the end of input
+    void ServeStream(std::istream& in, std::ostream& out, const Services& services);
+
+    // Runs ServeStream on every connection to a Unix domain socket, one connection at a time
+    void ServeSocket(const std::string& path, const Services& services);
+
+    // Sends the documents read from in to the server listening on path and prints its answers
+    void RunClient(const std::string& path, std::istream& in, std::ostream& out);
+
+} // namespace server
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "stop_index.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace transport {
+
+    namespace {
+
+        const double EARTH_RADIUS = 6371000;
+        const double DEGREE = M_PI / 180.;
+
+        bool IsCloser(const NearbyStop& lhs, const NearbyStop& rhs) {
+            if (lhs.distance != rhs.distance) {
+                return lhs.distance < rhs.distance;
+            }
+            return lhs.stop->name < rhs.stop->name;
+        }
+
+    } // namespace
+
+    StopIndex::StopIndex(double cell_size)
+        : cell_size_(cell_size) {
+    }
+
+    void StopIndex::Add(const Stop* stop) {
+        cells_[MakeKey(ToCell(stop->coords.latitude), ToCell(stop->coords.longitude))].push_back(stop);
+    }
+
+    void StopIndex::Remove(const Stop* stop) {
+        const auto it = cells_.find(MakeKey(ToCell(stop->coords.latitude), ToCell(stop->coords.longitude)));
+        if (it == cells_.end()) {
+            return;
+        }
+        auto& stops = it->second;
+        stops.erase(std::remove(stops.begin(), stops.end(), stop), stops.end());
+        if (stops.empty()) {
+            cells_.erase(it);
+        }
+    }
+
+    std::vector<const Stop*> StopIndex::FindInArea(const geo::BoundingBox& area) const {
+        std::vector<const Stop*> result;
+        if (area.min.latitude > area.max.latitude || area.min.longitude > area.max.longitude) {
+            return result;
+        }
+
+        const int min_lat_cell = ToCell(area.min.latitude);
+        const int max_lat_cell = ToCell(area.max.latitude);
+        const int min_lon_cell = ToCell(area.min.longitude);
+        const int max_lon_cell = ToCell(area.max.longitude);
+        const double area_cells = (static_cast<double>(max_lat_cell) - min_lat_cell + 1)
+            * (static_cast<double>(max_lon_cell) - min_lon_cell + 1);
+
+        // An area wider than the populated part of the grid is cheaper to scan cell by cell
+        if (area_cells > static_cast<double>(cells_.size())) {
+            for (const auto& [key, stops] : cells_) {
+                for (const Stop* stop : stops) {
+                    if (area.Contains(stop->coords)) {
+                        result.push_back(stop);
+                    }
+                }
+            }
+            return result;
+        }
+
+        for (int lat_cell = min_lat_cell; lat_cell <= max_lat_cell; ++lat_cell) {
+            for (int lon_cell = min_lon_cell; lon_cell <= max_lon_cell; ++lon_cell) {
+                auto it = cells_.find(MakeKey(lat_cell, lon_cell));
+                if (it == cells_.end()) {
+                    continue;
+                }
+                for (const Stop* stop : it->second) {
+                    if (area.Contains(stop->coords)) {
+                        result.push_back(stop);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    std::vector<NearbyStop> StopIndex::FindInRadius(geo::Coordinates center, double radius) const {
+        std::vector<NearbyStop> result;
+        if (radius < 0) {
+            return result;
+        }
+
+        // One degree of latitude is the same everywhere, one of longitude shrinks with cos(latitude)
+        const double lat_delta = radius / EARTH_RADIUS / DEGREE;
+        const double max_abs_lat = std::min(std::abs(center.latitude) + lat_delta, 90.0);
+        const double cos_lat = std::cos(max_abs_lat * DEGREE);
+        const double lon_delta = cos_lat * 180.0 > lat_delta ? lat_delta / cos_lat : 180.0;
+        const geo::BoundingBox area{
+            { center.latitude - lat_delta, center.longitude - lon_delta },
+            { center.latitude + lat_delta, center.longitude + lon_delta } };
+
+        for (const Stop* stop : FindInArea(area)) {
+            const double distance = geo::ComputeDistance(center, stop->coords);
+            if (distance <= radius) {
+                result.push_back({ stop, distance });
+            }
+        }
+        std::sort(result.begin(), result.end(), IsCloser);
+        return result;
+    }
+
+    std::vector<NearbyStop> StopIndex::FindNearest(geo::Coordinates center, size_t count) const {
+        std::vector<NearbyStop> candidates;
+        if (count == 0 || cells_.empty()) {
+            return candidates;
+        }
+
+        const int lat_cell = ToCell(center.latitude);
+        const int lon_cell = ToCell(center.longitude);
+        size_t visited_cells = 0;
+        size_t populated_cells = 0;
+
+        // Rings of cells around the center until nothing outside can beat the current k-th stop
+        for (int ring = 0;; ++ring) {
+            if (visited_cells >= cells_.size()) {
+                // Rings have cost as many lookups as there are populated cells, mostly empty ones
+                // when stops are sparse: one pass over the populated cells is cheaper from here
+                candidates.clear();
+                for (const auto& [key, stops] : cells_) {
+                    for (const Stop* stop : stops) {
+                        candidates.push_back({ stop, geo::ComputeDistance(center, stop->coords) });
+                    }
+                }
+                break;
+            }
+
+            for (int lat = lat_cell - ring; lat <= lat_cell + ring; ++lat) {
+                const bool is_edge_row = lat == lat_cell - ring || lat == lat_cell + ring;
+                const int lon_step = is_edge_row ? 1 : 2 * ring;
+                for (int lon = lon_cell - ring; lon <= lon_cell + ring; lon += lon_step) {
+                    populated_cells += CollectCell(lat, lon, center, candidates);
+                    ++visited_cells;
+                }
+            }
+            // Every stop is a candidate already
+            if (populated_cells == cells_.size()) {
+                break;
+            }
+
+            if (candidates.size() >= count) {
+                std::nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end(), IsCloser);
+                const double kth_distance = candidates[count - 1].distance;
+                if (kth_distance <= DistanceOutside(center, lat_cell - ring, lat_cell + ring, lon_cell - ring, lon_cell + ring)) {
+                    break;
+                }
+            }
+        }
+
+        const size_t result_size = std::min(count, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + result_size, candidates.end(), IsCloser);
+        candidates.resize(result_size);
+        return candidates;
+    }
+
+    bool StopIndex::CollectCell(int lat_cell, int lon_cell, geo::Coordinates center, std::vector<NearbyStop>& result) const {
+        auto it = cells_.find(MakeKey(lat_cell, lon_cell));
+        if (it == cells_.end()) {
+            return false;
+        }
+        for (const Stop* stop : it->second) {
+            result.push_back({ stop, geo::ComputeDistance(center, stop->coords) });
+        }
+        return true;
+    }
+
+    double StopIndex::DistanceOutside(geo::Coordinates center, int min_lat_cell, int max_lat_cell, int min_lon_cell, int max_lon_cell) const {
+        // A stop outside the cells is either beyond a latitude border, at least that far along
+        // a meridian, or beyond a longitude border, at least as far as that meridian's plane
+        const double lat_gap = std::min(center.latitude - min_lat_cell * cell_size_,
+            (max_lat_cell + 1) * cell_size_ - center.latitude);
+        const double lon_gap = std::min(center.longitude - min_lon_cell * cell_size_,
+            (max_lon_cell + 1) * cell_size_ - center.longitude);
+        const double lon_angle = std::asin(std::cos(center.latitude * DEGREE)
+            * std::sin(std::min(lon_gap * DEGREE, M_PI_2)));
+        return std::min(lat_gap * DEGREE, lon_angle) * EARTH_RADIUS;
+    }
+
+    int StopIndex::ToCell(double degrees) const {
+        return static_cast<int>(std::floor(degrees / cell_size_));
+    }
+
+    StopIndex::CellKey StopIndex::MakeKey(int lat_cell, int lon_cell) {
+        // Shifted as unsigned, cells south and west of zero are negative
+        return (static_cast<CellKey>(static_cast<std::uint32_t>(lat_cell)) << 32) | static_cast<std::uint32_t>(lon_cell);
+    }
+
+    size_t StopIndex::GetMemoryUsage() const {
+        size_t bytes = memory::HashMapBytes(cells_);
+        for (const auto& [key, stops] : cells_) {
+            bytes += memory::VectorBytes(stops);
+        }
+        return bytes;
+    }
+
+} // namespace transport
\ No newline at end of file
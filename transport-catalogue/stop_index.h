@@ -0,0 +1,43 @@
+#pragma once
+
+#include "domain.h"
+#include "geo.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+    // Uniform latitude/longitude grid over stops. Area queries only visit
+    // the cells covering the area, so their cost follows the result size
+    class StopIndex {
+    public:
+        explicit StopIndex(double cell_size = 0.01);
+
+        void Add(const Stop* stop);
+        // The stop must be in the cell of its current coordinates
+        void Remove(const Stop* stop);
+        std::vector<const Stop*> FindInArea(const geo::BoundingBox& area) const;
+        // Results are ordered by distance, then by name. The grid does not wrap
+        // around the 180th meridian, so stops across it are not found
+        std::vector<NearbyStop> FindInRadius(geo::Coordinates center, double radius) const;
+        std::vector<NearbyStop> FindNearest(geo::Coordinates center, size_t count) const;
+
+        size_t GetMemoryUsage() const;
+
+    private:
+        using CellKey = std::uint64_t;
+
+        int ToCell(double degrees) const;
+        static CellKey MakeKey(int lat_cell, int lon_cell);
+        // Appends the stops of the cell with their distances to the center, false if the cell is empty
+        bool CollectCell(int lat_cell, int lon_cell, geo::Coordinates center, std::vector<NearbyStop>& result) const;
+        // Lower bound of the distance from the center to stops outside cells [min, max] around it
+        double DistanceOutside(geo::Coordinates center, int min_lat_cell, int max_lat_cell, int min_lon_cell, int max_lon_cell) const;
+
+        double cell_size_;
+        std::unordered_map<CellKey, std::vector<const Stop*>> cells_;
+    };
+
+} // namespace transport
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "svg.h"
 
+#include <charconv>
+#include <iterator>
+
 namespace svg {
 
     using namespace std::literals;
@@ -8,40 +11,40 @@ namespace svg {
         std::visit(ColorPrinter{ out }, color);
         return out;
     }
-    std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap) {
+    std::string_view ToString(StrokeLineCap line_cap) {
         switch (line_cap) {
         case StrokeLineCap::BUTT:
-            out << "butt"sv;
-            break;
+            return "butt"sv;
         case StrokeLineCap::ROUND:
-            out << "round"sv;
-            break;
+            return "round"sv;
         case StrokeLineCap::SQUARE:
-            out << "square"sv;
-            break;
+            return "square"sv;
         }
-        return out;
+        return {};
     }
 
-    std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join) {
+    std::string_view ToString(StrokeLineJoin line_join) {
         switch (line_join) {
         case StrokeLineJoin::ARCS:
-            out << "arcs"sv;
-            break;
+            return "arcs"sv;
         case StrokeLineJoin::BEVEL:
-            out << "bevel"sv;
-            break;
+            return "bevel"sv;
         case StrokeLineJoin::MITER:
-            out << "miter"sv;
-            break;
+            return "miter"sv;
         case StrokeLineJoin::MITER_CLIP:
-            out << "miter-clip"sv;
-            break;
+            return "miter-clip"sv;
         case StrokeLineJoin::ROUND:
-            out << "round"sv;
-            break;
+            return "round"sv;
         }
-        return out;
+        return {};
+    }
+
+    std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap) {
+        return out << ToString(line_cap);
+    }
+
+    std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join) {
+        return out << ToString(line_join);
     }
 
     void Object::Render(const RenderContext& context) const {
@@ -49,7 +52,7 @@ namespace svg {
 
         RenderObject(context);
 
-        context.out << std::endl;
+        context.out.put('\n');
     }
 
     // ---------- Circle ------------------
@@ -149,12 +152,259 @@ namespace svg {
 
     void Document::Render(std::ostream& out) const {
         RenderContext ctx(out, 2, 2);
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
         for (const auto& obj : objects_) {
             obj->Render(ctx);
         }
         out << "</svg>"sv;
     }
 
+    // ---------- Writer ------------------
+
+    Writer::Writer(std::string& out)
+        : out_(out) {
+    }
+
+    void Writer::StartDocument() {
+        Append("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv);
+        Append("<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv);
+    }
+
+    void Writer::EndDocument() {
+        Append("</svg>"sv);
+    }
+
+    void Writer::WriteCircle(Point center, double radius, const PathAttrs& attrs) {
+        Append("  <circle cx=\""sv);
+        Append(center.x);
+        Append("\" cy=\""sv);
+        Append(center.y);
+        Append("\" r=\""sv);
+        Append(radius);
+        Append("\""sv);
+        AppendAttrs(attrs);
+        Append("/>\n"sv);
+    }
+
+    void Writer::StartPolyline() {
+        Append("  <polyline points=\""sv);
+        is_first_point_ = true;
+    }
+
+    void Writer::AddPolylinePoint(Point point) {
+        if (!is_first_point_) {
+            out_.push_back(' ');
+        }
+        is_first_point_ = false;
+        Append(point.x);
+        out_.push_back(',');
+        Append(point.y);
+    }
+
+    void Writer::EndPolyline(const PathAttrs& attrs) {
+        Append("\""sv);
+        AppendAttrs(attrs);
+        Append("/>\n"sv);
+    }
+
+    void Writer::WriteText(Point pos, Point offset, uint32_t size, std::string_view font_family,
+        std::string_view font_weight, std::string_view data, const PathAttrs& attrs) {
+        Append("  <text"sv);
+        AppendAttrs(attrs);
+        AppendPosition(pos, offset);
+        Append("\" font-size=\""sv);
+        Append(static_cast<int>(size));
+        Append("\""sv);
+        if (!font_family.empty()) {
+            Append(" font-family=\""sv);
+            Append(font_family);
+            Append("\" "sv);
+        }
+        if (!font_weight.empty()) {
+            Append("font-weight=\""sv);
+            Append(font_weight);
+            Append("\""sv);
+        }
+        Append(">"sv);
+        Append(data);
+        Append("</text>\n"sv);
+    }
+
+    void Writer::WriteStyle(const std::vector<StyleClass>& classes) {
+        Append("  <style>\n"sv);
+        for (const StyleClass& style_class : classes) {
+            Append("    ."sv);
+            Append(std::string_view(style_class.name));
+            out_.push_back('{');
+
+            // CSS declarations, each property as in AppendAttrs
+            char separator = '\0';
+            auto declare = [this, &separator](std::string_view property) {
+                if (separator) {
+                    out_.push_back(separator);
+                }
+                separator = ';';
+                Append(property);
+                out_.push_back(':');
+            };
+            const PathAttrs& attrs = style_class.attrs;
+            if (attrs.fill_color) {
+                declare("fill"sv);
+                Append(*attrs.fill_color);
+            }
+            if (attrs.stroke_color) {
+                declare("stroke"sv);
+                Append(*attrs.stroke_color);
+            }
+            if (attrs.stroke_width) {
+                declare("stroke-width"sv);
+                Append(*attrs.stroke_width);
+            }
+            if (attrs.line_cap) {
+                declare("stroke-linecap"sv);
+                Append(ToString(*attrs.line_cap));
+            }
+            if (attrs.line_join) {
+                declare("stroke-linejoin"sv);
+                Append(ToString(*attrs.line_join));
+            }
+            if (style_class.font_size) {
+                declare("font-size"sv);
+                Append(static_cast<int>(*style_class.font_size));
+                Append("px"sv);
+            }
+            if (!style_class.font_family.empty()) {
+                declare("font-family"sv);
+                Append(std::string_view(style_class.font_family));
+            }
+            if (!style_class.font_weight.empty()) {
+                declare("font-weight"sv);
+                Append(std::string_view(style_class.font_weight));
+            }
+
+            Append("}\n"sv);
+        }
+        Append("  </style>\n"sv);
+    }
+
+    void Writer::WriteCircle(Point center, double radius, std::string_view class_name) {
+        Append("  <circle"sv);
+        AppendClass(class_name);
+        Append(" cx=\""sv);
+        Append(center.x);
+        Append("\" cy=\""sv);
+        Append(center.y);
+        Append("\" r=\""sv);
+        Append(radius);
+        Append("\"/>\n"sv);
+    }
+
+    void Writer::EndPolyline(std::string_view class_name) {
+        Append("\""sv);
+        AppendClass(class_name);
+        Append("/>\n"sv);
+    }
+
+    void Writer::WriteText(Point pos, Point offset, std::string_view data, std::string_view class_name) {
+        Append("  <text"sv);
+        AppendClass(class_name);
+        AppendPosition(pos, offset);
+        Append("\">"sv);
+        Append(data);
+        Append("</text>\n"sv);
+    }
+
+    void Writer::Append(std::string_view text) {
+        out_.append(text);
+    }
+
+    void Writer::Append(double value) {
+        // Same as the default std::ostream formatting (%g with precision 6)
+        char buffer[32];
+        const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::general, 6);
+        out_.append(buffer, result.ptr);
+    }
+
+    void Writer::Append(int value) {
+        char buffer[16];
+        const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+        out_.append(buffer, result.ptr);
+    }
+
+    void Writer::Append(const Color& color) {
+        if (std::holds_alternative<std::monostate>(color)) {
+            Append("none"sv);
+        }
+        else if (const auto* name = std::get_if<std::string>(&color)) {
+            Append(std::string_view(*name));
+        }
+        else if (const auto* rgb = std::get_if<Rgb>(&color)) {
+            Append("rgb("sv);
+            Append(static_cast<int>(rgb->red));
+            out_.push_back(',');
+            Append(static_cast<int>(rgb->green));
+            out_.push_back(',');
+            Append(static_cast<int>(rgb->blue));
+            out_.push_back(')');
+        }
+        else if (const auto* rgba = std::get_if<Rgba>(&color)) {
+            Append("rgba("sv);
+            Append(static_cast<int>(rgba->red));
+            out_.push_back(',');
+            Append(static_cast<int>(rgba->green));
+            out_.push_back(',');
+            Append(static_cast<int>(rgba->blue));
+            out_.push_back(',');
+            Append(rgba->opacity);
+            out_.push_back(')');
+        }
+    }
+
+    void Writer::AppendClass(std::string_view class_name) {
+        Append(" class=\""sv);
+        Append(class_name);
+        Append("\""sv);
+    }
+
+    // Leaves the dy value open for the caller to close
+    void Writer::AppendPosition(Point pos, Point offset) {
+        Append(" x=\""sv);
+        Append(pos.x);
+        Append("\" y=\""sv);
+        Append(pos.y);
+        Append("\" dx=\""sv);
+        Append(offset.x);
+        Append("\" dy=\""sv);
+        Append(offset.y);
+    }
+
+    void Writer::AppendAttrs(const PathAttrs& attrs) {
+        if (attrs.fill_color) {
+            Append(" fill=\""sv);
+            Append(*attrs.fill_color);
+            Append("\""sv);
+        }
+        if (attrs.stroke_color) {
+            Append(" stroke=\""sv);
+            Append(*attrs.stroke_color);
+            Append("\""sv);
+        }
+        if (attrs.stroke_width) {
+            Append(" stroke-width=\""sv);
+            Append(*attrs.stroke_width);
+            Append("\""sv);
+        }
+        if (attrs.line_cap) {
+            Append(" stroke-linecap=\""sv);
+            Append(ToString(*attrs.line_cap));
+            Append("\""sv);
+        }
+        if (attrs.line_join) {
+            Append(" stroke-linejoin=\""sv);
+            Append(ToString(*attrs.line_join));
+            Append("\""sv);
+        }
+    }
+
 }  // namespace svg
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <string_view>
 #include <variant>
 
 namespace svg {
@@ -78,6 +79,9 @@ namespace svg {
         ROUND,
     };
 
+    std::string_view ToString(StrokeLineCap line_cap);
+    std::string_view ToString(StrokeLineJoin line_join);
+
     std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap);
     std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join);
 
@@ -266,4 +270,59 @@ namespace svg {
         std::vector<std::unique_ptr<Object>> objects_;
     };
 
+    // Presentation attributes for Writer, rendered in the same order as PathProps
+    struct PathAttrs {
+        const Color* fill_color = nullptr;
+        const Color* stroke_color = nullptr;
+        std::optional<double> stroke_width;
+        std::optional<StrokeLineCap> line_cap;
+        std::optional<StrokeLineJoin> line_join;
+    };
+
+    // Attributes shared by elements through one class of the <style> block
+    struct StyleClass {
+        std::string name;
+        PathAttrs attrs;
+        std::optional<uint32_t> font_size;
+        std::string font_family;
+        std::string font_weight;
+    };
+
+    // Appends SVG markup straight to a string buffer without building objects.
+    // The output is byte-identical to Document::Render for the same elements
+    class Writer {
+    public:
+        explicit Writer(std::string& out);
+
+        void StartDocument();
+        void EndDocument();
+
+        void WriteCircle(Point center, double radius, const PathAttrs& attrs);
+
+        void StartPolyline();
+        void AddPolylinePoint(Point point);
+        void EndPolyline(const PathAttrs& attrs);
+
+        void WriteText(Point pos, Point offset, uint32_t size, std::string_view font_family,
+            std::string_view font_weight, std::string_view data, const PathAttrs& attrs);
+
+        // Elements taking their attributes from a class written by WriteStyle
+        void WriteStyle(const std::vector<StyleClass>& classes);
+        void WriteCircle(Point center, double radius, std::string_view class_name);
+        void EndPolyline(std::string_view class_name);
+        void WriteText(Point pos, Point offset, std::string_view data, std::string_view class_name);
+
+    private:
+        void Append(std::string_view text);
+        void Append(double value);
+        void Append(int value);
+        void Append(const Color& color);
+        void AppendAttrs(const PathAttrs& attrs);
+        void AppendClass(std::string_view class_name);
+        void AppendPosition(Point pos, Point offset);
+
+        std::string& out_;
+        bool is_first_point_ = true;
+    };
+
 }  // namespace svg
\ No newline at end of file
@@ -1,34 +1,82 @@
 #include "transport_catalogue.h"
 
+#include "memory_usage.h"
+
 namespace transport {
 
     void TransportCatalogue::AddStop(std::string_view stop_name, geo::Coordinates coords) {
-        stops_.emplace_back(Stop{ std::string(stop_name), coords });
-        stop_names_.emplace(stop_name, &stops_.back());
+        if (const auto it = stop_names_.find(stop_name); it != stop_names_.end()) {
+            if (changes_) {
+                changes_->moved_stops.emplace_back(it->second, it->second->coords);
+            }
+            MoveStop(it->second, coords);
+            return;
+        }
+        stops_.emplace_back(Stop{ std::string(stop_name), coords, stops_.size() });
+        // Keys refer to names stored here, so callers' strings may go away
+        stop_names_.emplace(stops_.back().name, &stops_.back());
+        stop_index_.Add(&stops_.back());
+        stop_latitudes_.push_back(coords.latitude);
+        stop_longitudes_.push_back(coords.longitude);
+        stop_unit_vectors_.push_back(geo::ToUnitVector(coords));
+        stop_buses_.emplace_back();
+        ++version_;
+    }
+
+    void TransportCatalogue::MoveStop(Stop* stop, geo::Coordinates coords) {
+        stop_index_.Remove(stop);
+        stop->coords = coords;
+        stop_index_.Add(stop);
+        stop_latitudes_[stop->id] = coords.latitude;
+        stop_longitudes_[stop->id] = coords.longitude;
+        stop_unit_vectors_[stop->id] = geo::ToUnitVector(coords);
+        ++version_;
     }
 
     void TransportCatalogue::AddBus(std::string_view route_name, const std::vector<std::string_view>& stop_names, bool is_circular) {
-        BusRoute route{ std::string(route_name), {}, 0, is_circular, 0 };
-        BusRoute route_one_trip{ std::string(route_name), {}, 0, is_circular, 0 };
-        std::unordered_set<Stop*> unique_stops_set;
+        BusRoute* route = nullptr;
+        if (const auto it = bus_routes_.find(route_name); it != bus_routes_.end()) {
+            route = it->second;
+            if (changes_) {
+                changes_->replaced_buses.push_back(*route);
+            }
+            RemoveFromStops(route);
+        }
+        else {
+            buses_.push_back(BusRoute{ std::string(route_name), {}, 0, is_circular, 0 });
+            route = &buses_.back();
+            bus_routes_.emplace(route->name, route);
+        }
 
+        route->stops.clear();
+        route->is_circular = is_circular;
+        std::unordered_set<Stop*> unique_stops_set;
         for (const auto& stop_name : stop_names) {
             auto it = stop_names_.find(stop_name);
             if (it != stop_names_.end()) {
                 Stop* stop = it->second;
-                route.stops.push_back(stop);
+                route->stops.push_back(stop);
                 unique_stops_set.insert(stop);
-                stop_to_buses_[stop_name].insert(route_name);
             }
         }
+        AddToStops(route);
 
-        route.unique_stops = unique_stops_set.size();
+        route->unique_stops = unique_stops_set.size();
 
-        route.total_stops = route.stops.size();
+        route->total_stops = route->stops.size();
+        ++version_;
+    }
 
-        buses_.emplace_back(route);
-        bus_routes_.emplace(route_name, &buses_.back());
+    void TransportCatalogue::RemoveFromStops(const BusRoute* route) {
+        for (const Stop* stop : route->stops) {
+            stop_buses_[stop->id].erase(route->name);
+        }
+    }
 
+    void TransportCatalogue::AddToStops(const BusRoute* route) {
+        for (const Stop* stop : route->stops) {
+            stop_buses_[stop->id].insert(route->name);
+        }
     }
 
     bool TransportCatalogue::StopExists(std::string_view name) const {
@@ -59,9 +107,9 @@ namespace transport {
 
     std::vector<std::string> TransportCatalogue::GetBusesByStop(std::string_view stop_name) const {
         std::vector<std::string> buses;
-        auto it = stop_to_buses_.find(stop_name);
-        if (it != stop_to_buses_.end()) {
-            for (const auto& bus : it->second) {
+        auto it = stop_names_.find(stop_name);
+        if (it != stop_names_.end()) {
+            for (const auto& bus : stop_buses_[it->second->id]) {
                 buses.push_back(std::string(bus));
             }
         }
@@ -70,8 +118,13 @@ namespace transport {
 
     void TransportCatalogue::SetRoadDistance(const Stop* stopA, const Stop* stopB, double distance) {
         if (stopA && stopB) {
-            auto dist_pair = std::make_pair(stopA, stopB);
-            distances_.insert(DistanceMap::value_type(dist_pair, distance));
+            if (changes_) {
+                const auto it = distances_.find(std::make_pair(stopA, stopB));
+                changes_->distances.emplace_back(std::make_pair(stopA, stopB),
+                    it != distances_.end() ? std::optional<double>(it->second) : std::nullopt);
+            }
+            distances_.insert_or_assign(std::make_pair(stopA, stopB), distance);
+            ++version_;
         }
     }
 
@@ -91,56 +144,92 @@ namespace transport {
         return sorted_stops;
     }
 
+    const std::vector<double>& TransportCatalogue::GetStopLatitudes() const {
+        return stop_latitudes_;
+    }
+
+    const std::vector<double>& TransportCatalogue::GetStopLongitudes() const {
+        return stop_longitudes_;
+    }
+
+    std::vector<const Stop*> TransportCatalogue::GetStopsInArea(const geo::BoundingBox& area) const {
+        return stop_index_.FindInArea(area);
+    }
+
+    std::vector<NearbyStop> TransportCatalogue::GetStopsInRadius(geo::Coordinates center, double radius) const {
+        return stop_index_.FindInRadius(center, radius);
+    }
+
+    std::vector<NearbyStop> TransportCatalogue::GetNearestStops(geo::Coordinates center, size_t count) const {
+        return stop_index_.FindNearest(center, count);
+    }
+
     std::optional<InfoStop> TransportCatalogue::GetStopInfo(std::string_view stop_name) const {
-        auto it = stop_to_buses_.find(stop_name);
+        auto it = stop_names_.find(stop_name);
+        if (it != stop_names_.end()) {
+            return GetStopInfo(it->second);
+        }
         InfoStop info;
         info.name = stop_name;
-        if (it != stop_to_buses_.end()) {
-            info.buses = std::vector<std::string>(it->second.begin(), it->second.end());
-            std::sort(info.buses.begin(), info.buses.end());
-            return info;
-        }
-        else {
-            info.buses = {};
-            return info;
-        }
+        return info;
+    }
+
+    InfoStop TransportCatalogue::GetStopInfo(const Stop* stop) const {
+        const auto& buses = stop_buses_[stop->id];
+        InfoStop info;
+        info.name = stop->name;
+        info.buses = std::vector<std::string>(buses.begin(), buses.end());
+        std::sort(info.buses.begin(), info.buses.end());
         return info;
     }
 
     std::optional<InfoRoute> TransportCatalogue::GetBusInfo(std::string_view bus_name) const {
-        InfoRoute info = { 0, 0, 0.0, 0.0, false };
         auto it = bus_routes_.find(bus_name);
         if (it != bus_routes_.end()) {
-            const BusRoute& route = *(it->second);
+            return GetBusInfo(it->second);
+        }
+        return std::nullopt;
+    }
+
+    InfoRoute TransportCatalogue::GetBusInfo(const BusRoute* bus_route) const {
+        InfoRoute info = { 0, 0, 0.0, 0.0, false };
+        const BusRoute& route = *bus_route;
+        if (route.is_circular) {
+            info.stops_count = route.stops.size();
+        }
+        else {
+            info.stops_count = route.stops.size() * 2 - 1;
+        }
+        info.unique_stops_count = route.unique_stops;
+        info.is_roundtrip = route.is_circular;
+
+        // Consecutive stops as unit vectors, so segment i runs from points[i] to points[i + 1]
+        std::vector<geo::UnitVector> points;
+        points.reserve(route.stops.size());
+        for (const Stop* stop : route.stops) {
+            points.push_back(stop_unit_vectors_[stop->id]);
+        }
+        std::vector<double> segment_lengths(points.empty() ? 0 : points.size() - 1);
+        geo::ComputeDistances(points.data(), points.data() + 1, segment_lengths.data(), segment_lengths.size());
+
+        int length = 0;
+        double length_geo = 0.0;
+        for (size_t i = 0; i < route.stops.size() - 1; ++i) {
+            auto from = route.stops[i];
+            auto to = route.stops[i + 1];
+
             if (route.is_circular) {
-                info.stops_count = route.stops.size();
+                length += GetDistance(from, to);
+                length_geo += segment_lengths[i];
             }
             else {
-                info.stops_count = route.stops.size() * 2 - 1;
+                length += GetDistance(from, to) + GetDistance(to, from);
+                length_geo += segment_lengths[i] * 2;
             }
-            info.unique_stops_count = route.unique_stops;
-            info.is_roundtrip = route.is_circular;
-
-            int length = 0;
-            double length_geo = 0.0;
-            for (size_t i = 0; i < route.stops.size() - 1; ++i) {
-                auto from = route.stops[i];
-                auto to = route.stops[i + 1];
-
-                if (route.is_circular) {
-                    length += GetDistance(from, to);
-                    length_geo += geo::ComputeDistance(from->coords, to->coords);
-                }
-                else {
-                    length += GetDistance(from, to) + GetDistance(to, from);
-                    length_geo += geo::ComputeDistance(from->coords, to->coords) * 2;
-                }
-            }
-            info.length = length;
-            info.curvature = length / length_geo;
-            return info;
         }
-        return std::nullopt;
+        info.length = length;
+        info.curvature = length / length_geo;
+        return info;
     }
 
     double TransportCatalogue::GetDistance(const Stop* from, const Stop* to) const {
@@ -154,4 +243,102 @@ namespace transport {
         return 0.0;
     }
 
+    std::vector<RoadDistance> TransportCatalogue::GetRoadDistances() const {
+        std::vector<RoadDistance> road_distances;
+        road_distances.reserve(distances_.size());
+        for (const auto& [stops, distance] : distances_) {
+            road_distances.push_back({ stops.first, stops.second, distance });
+        }
+        return road_distances;
+    }
+
+    size_t TransportCatalogue::GetStopCount() const {
+        return stops_.size();
+    }
+
+    size_t TransportCatalogue::GetVersion() const {
+        return version_;
+    }
+
+    std::vector<std::pair<std::string_view, size_t>> TransportCatalogue::GetMemoryUsage() const {
+        size_t stops = memory::DequeBytes(stops_);
+        for (const Stop& stop : stops_) {
+            stops += memory::StringBytes(stop.name);
+        }
+        size_t buses = memory::DequeBytes(buses_);
+        for (const BusRoute& bus : buses_) {
+            buses += memory::StringBytes(bus.name) + memory::VectorBytes(bus.stops);
+        }
+        size_t stop_to_buses = memory::VectorBytes(stop_buses_);
+        for (const auto& buses_at_stop : stop_buses_) {
+            stop_to_buses += memory::HashMapBytes(buses_at_stop);
+        }
+        return {
+            { "catalogue.stops", stops },
+            { "catalogue.buses", buses },
+            { "catalogue.name_maps", memory::HashMapBytes(stop_names_) + memory::HashMapBytes(bus_routes_) },
+            { "catalogue.stop_to_buses", stop_to_buses },
+            { "catalogue.distances", memory::HashMapBytes(distances_) },
+            { "catalogue.stop_index", stop_index_.GetMemoryUsage() },
+            { "catalogue.stop_arrays", memory::VectorBytes(stop_latitudes_) + memory::VectorBytes(stop_longitudes_)
+                + memory::VectorBytes(stop_unit_vectors_) },
+        };
+    }
+
+    void TransportCatalogue::StartChanges() {
+        changes_.emplace();
+        changes_->stop_count = stops_.size();
+        changes_->bus_count = buses_.size();
+    }
+
+    void TransportCatalogue::FinishChanges() {
+        changes_.reset();
+    }
+
+    void TransportCatalogue::UndoChanges() {
+        ChangeLog changes = std::move(*changes_);
+        changes_.reset();
+
+        // In reverse order of the changes, so values changed twice end up as they were first
+        for (auto it = changes.distances.rbegin(); it != changes.distances.rend(); ++it) {
+            if (it->second) {
+                distances_[it->first] = *it->second;
+            }
+            else {
+                distances_.erase(it->first);
+            }
+        }
+
+        for (auto it = changes.replaced_buses.rbegin(); it != changes.replaced_buses.rend(); ++it) {
+            BusRoute* route = bus_routes_.at(it->name);
+            RemoveFromStops(route);
+            route->stops = std::move(it->stops);
+            route->unique_stops = it->unique_stops;
+            route->is_circular = it->is_circular;
+            route->total_stops = it->total_stops;
+            AddToStops(route);
+        }
+        while (buses_.size() > changes.bus_count) {
+            RemoveFromStops(&buses_.back());
+            bus_routes_.erase(buses_.back().name);
+            buses_.pop_back();
+        }
+
+        for (auto it = changes.moved_stops.rbegin(); it != changes.moved_stops.rend(); ++it) {
+            MoveStop(it->first, it->second);
+        }
+        // Buses and distances referring to added stops are gone already
+        while (stops_.size() > changes.stop_count) {
+            Stop* stop = &stops_.back();
+            stop_index_.Remove(stop);
+            stop_names_.erase(stop->name);
+            stop_latitudes_.pop_back();
+            stop_longitudes_.pop_back();
+            stop_unit_vectors_.pop_back();
+            stop_buses_.pop_back();
+            stops_.pop_back();
+        }
+        ++version_;
+    }
+
 } // namespace transport
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "domain.h"
+#include "stop_index.h"
 
 #include <algorithm>
 #include <cassert>
@@ -22,6 +23,8 @@ namespace transport {
     class TransportCatalogue {
     public:
 
+        // Adding a stop or bus with a known name replaces it in place: pointers to it stay valid
+        // and only what refers to it is updated, so patches cost as much as they change
         void AddStop(std::string_view stop_name, geo::Coordinates coords);
         void AddBus(std::string_view route_name, const std::vector<std::string_view>& stop_names, bool is_circular);
         bool StopExists(std::string_view name) const;
@@ -29,27 +32,71 @@ namespace transport {
         const Stop* GetStopByName(std::string_view name) const;
         const BusRoute* GetBusByName(std::string_view name) const;
         std::vector<std::string> GetBusesByStop(std::string_view stop_name) const;
+        // Replaces the distance if it is already set
         void SetRoadDistance(const Stop* stopA, const Stop* stopB, double distance);
         std::map<std::string_view, const BusRoute*> GetSortedBuses() const;
         std::map<std::string_view, const Stop*> GetSortedStops() const;
+        // Coordinates of all stops as separate contiguous arrays indexed by Stop::id
+        const std::vector<double>& GetStopLatitudes() const;
+        const std::vector<double>& GetStopLongitudes() const;
+        std::vector<const Stop*> GetStopsInArea(const geo::BoundingBox& area) const;
+        // Closest stops first, distances in meters
+        std::vector<NearbyStop> GetStopsInRadius(geo::Coordinates center, double radius) const;
+        std::vector<NearbyStop> GetNearestStops(geo::Coordinates center, size_t count) const;
         std::optional <InfoStop> GetStopInfo(std::string_view stop_name) const;
+        InfoStop GetStopInfo(const Stop* stop) const;
         std::optional <InfoRoute> GetBusInfo(std::string_view bus_name) const;
+        InfoRoute GetBusInfo(const BusRoute* bus_route) const;
         double GetDistance(const Stop* from, const Stop* to) const;
+        // Every distance set by SetRoadDistance, in no particular order
+        std::vector<RoadDistance> GetRoadDistances() const;
+        size_t GetStopCount() const;
+        // Incremented on every modification, lets dependent caches detect stale data
+        size_t GetVersion() const;
+        // Heap bytes of each part of the catalogue
+        std::vector<std::pair<std::string_view, size_t>> GetMemoryUsage() const;
+
+        // Changes made between StartChanges and FinishChanges are recorded, so that UndoChanges
+        // can revert them, e.g. when a patch turns out too large to route
+        void StartChanges();
+        void FinishChanges();
+        void UndoChanges();
 
     private:
+        void MoveStop(Stop* stop, geo::Coordinates coords);
+        // Takes the bus off the bus lists of its stops
+        void RemoveFromStops(const BusRoute* route);
+        void AddToStops(const BusRoute* route);
+
+        // What UndoChanges needs: counts to drop added stops and buses, and old values of the others
+        struct ChangeLog {
+            size_t stop_count = 0;
+            size_t bus_count = 0;
+            std::vector<std::pair<Stop*, geo::Coordinates>> moved_stops;
+            std::vector<BusRoute> replaced_buses;
+            std::vector<std::pair<std::pair<const Stop*, const Stop*>, std::optional<double>>> distances;
+        };
+
         std::deque<Stop> stops_;
         std::deque<BusRoute> buses_;
 
         using StopMap = std::unordered_map<std::string_view, Stop*>;
         using BusRouteMap = std::unordered_map<std::string_view, BusRoute*>;
         using BusRouteMapOneTrip = std::unordered_map<std::string_view, BusRoute*>;
-        using StopsMap = std::unordered_map<std::string_view, std::unordered_set<std::string_view>>;
         using DistanceMap = std::unordered_map<std::pair<const Stop*, const Stop*>, double, StopsHasher>;
 
         StopMap stop_names_;
         BusRouteMap bus_routes_;
-        StopsMap stop_to_buses_;
         DistanceMap distances_;
+        StopIndex stop_index_;
+        std::vector<double> stop_latitudes_;
+        std::vector<double> stop_longitudes_;
+        // Indexed by Stop::id, used for geographic route lengths
+        std::vector<geo::UnitVector> stop_unit_vectors_;
+        // Indexed by Stop::id, names of the buses through the stop
+        std::vector<std::unordered_set<std::string_view>> stop_buses_;
+        size_t version_ = 0;
+        std::optional<ChangeLog> changes_;
 
     };
 
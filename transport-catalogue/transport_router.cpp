@@ -1,28 +1,203 @@
 #include "transport_router.h"
 
+#include "instrumentation.h"
+#include "memory_usage.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
 namespace transport {
 
+    namespace {
+
+        // Costs measured with -O2 on generated cities: one step of the all-pairs relaxation,
+        // and one visited vertex or edge of a search scaled by the heap depth
+        const double ALL_PAIRS_NS_PER_STEP = 0.6;
+        const double DIJKSTRA_NS_PER_STEP = 1.2;
+
+        // Same layout as the all-pairs table entry of graph::Router, one per ordered pair of vertices
+        struct RouteTableEntry {
+            double weight;
+            std::optional<graph::EdgeId> prev_edge;
+        };
+
+        // The graph is built edge by edge, so every vector has the capacity push_back grows it to
+        size_t GetGraphMemoryUsage(const graph::DirectedWeightedGraph<double>& graph) {
+            size_t bytes = memory::GrownCapacity(graph.GetEdgeCount()) * sizeof(graph::Edge<double>)
+                + graph.GetVertexCount() * sizeof(std::vector<graph::EdgeId>);
+            for (graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+                bytes += memory::StringBytes(graph.GetEdge(edge_id).name);
+            }
+            for (graph::VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+                const auto edges = graph.GetIncidentEdges(vertex);
+                bytes += memory::GrownCapacity(edges.end() - edges.begin()) * sizeof(graph::EdgeId);
+            }
+            return bytes;
+        }
+
+        const char* ToString(RoutingStrategy strategy) {
+            switch (strategy) {
+            case RoutingStrategy::ALL_PAIRS:
+                return "all_pairs";
+            case RoutingStrategy::DIJKSTRA:
+                return "dijkstra";
+            case RoutingStrategy::FASTEST:
+                return "fastest";
+            default:
+                return "auto";
+            }
+        }
+
+        std::string DescribePlan(const RoutingPlan& plan) {
+            std::ostringstream description;
+            description << "router: " << ToString(plan.strategy) << " for " << plan.memory.vertex_count << " vertices, "
+                << plan.memory.edge_count << " edges and ";
+            if (plan.route_query_count) {
+                description << *plan.route_query_count;
+            }
+            else {
+                description << "unknown";
+            }
+            description << " route queries; estimated all_pairs " << plan.all_pairs_ms << " ms, "
+                << (plan.memory.GetTotal() >> 10) << " KB, dijkstra " << plan.dijkstra_ms << " ms, "
+                << (plan.memory.graph_bytes >> 10) << " KB";
+            return description.str();
+        }
+
+    } // namespace
+
     Router::Router(int bus_wait_time, double bus_velocity)
         : bus_wait_time_(bus_wait_time), bus_velocity_(bus_velocity) {
     }
 
     Router::Router(const Router& settings, const TransportCatalogue& catalogue)
-        : bus_wait_time_(settings.bus_wait_time_), bus_velocity_(settings.bus_velocity_) {
+        : bus_wait_time_(settings.bus_wait_time_), bus_velocity_(settings.bus_velocity_)
+        , strategy_(settings.strategy_), route_query_count_(settings.route_query_count_)
+        , memory_budget_(settings.memory_budget_) {
+        const RoutingPlan plan = Plan(catalogue);
+        if (instrumentation::IsEnabled()) {
+            instrumentation::Log(DescribePlan(plan));
+            instrumentation::RecordMemoryUsage("router.graph.estimate", plan.memory.graph_bytes);
+        }
         BuildGraph(catalogue);
+
+        if (plan.strategy == RoutingStrategy::DIJKSTRA) {
+            dijkstra_router_ = std::make_unique<graph::DijkstraRouter<double>>(graph_);
+            return;
+        }
+        instrumentation::Span span("graph.Router");
+        router_ = std::make_unique<graph::Router<double>>(graph_);
+        if (instrumentation::IsEnabled()) {
+            instrumentation::RecordMemoryUsage("router.route_table", plan.memory.route_table_bytes);
+        }
     }
 
-    const graph::DirectedWeightedGraph<double>& Router::BuildGraph(const TransportCatalogue& catalogue) {
-        const auto& stops_map = catalogue.GetSortedStops();
-        const auto& buses_map = catalogue.GetSortedBuses();
-        graph::DirectedWeightedGraph<double> transport_graph(stops_map.size() * 2);
-        stop_vertex_ids_.clear();
+    void Router::SetStrategy(RoutingStrategy strategy) {
+        strategy_ = strategy;
+    }
 
-        AddStopsToGraph(stops_map, transport_graph);
-        AddBusesToGraph(buses_map, transport_graph, catalogue);
+    void Router::SetRouteQueryCount(size_t count) {
+        route_query_count_ = count;
+    }
 
-        graph_ = std::move(transport_graph);
-        router_ = std::make_unique<graph::Router<double>>(graph_);
+    void Router::SetMemoryBudget(size_t bytes) {
+        memory_budget_ = bytes;
+    }
+
+    std::optional<size_t> Router::GetMemoryBudget() const {
+        return memory_budget_;
+    }
+
+    size_t RoutingPlan::GetMemoryUsage() const {
+        return strategy == RoutingStrategy::ALL_PAIRS ? memory.GetTotal() : memory.graph_bytes;
+    }
+
+    RoutingPlan Router::Plan(const TransportCatalogue& catalogue) const {
+        RoutingPlan plan;
+        plan.memory = EstimateMemoryUsage(catalogue);
+        plan.route_query_count = route_query_count_;
+
+        const auto vertices = static_cast<double>(plan.memory.vertex_count);
+        const auto edges = static_cast<double>(plan.memory.edge_count);
+        plan.all_pairs_ms = ALL_PAIRS_NS_PER_STEP * vertices * vertices * vertices / 1e6;
+        plan.dijkstra_ms = route_query_count_
+            ? static_cast<double>(*route_query_count_) * DIJKSTRA_NS_PER_STEP * (vertices + edges) * std::log2(vertices + 2) / 1e6
+            : std::numeric_limits<double>::infinity();
 
+        plan.strategy = strategy_;
+        const bool fits = !memory_budget_ || plan.memory.GetTotal() <= *memory_budget_;
+        if (strategy_ == RoutingStrategy::AUTO) {
+            // Answers stay the same as with the precomputed table whenever it can be built
+            plan.strategy = fits ? RoutingStrategy::ALL_PAIRS : RoutingStrategy::DIJKSTRA;
+        }
+        else if (strategy_ == RoutingStrategy::FASTEST) {
+            plan.strategy = fits && plan.all_pairs_ms <= plan.dijkstra_ms ? RoutingStrategy::ALL_PAIRS : RoutingStrategy::DIJKSTRA;
+        }
+        return plan;
+    }
+
+    RouterMemoryEstimate Router::EstimateMemoryUsage(const TransportCatalogue& catalogue) {
+        RouterMemoryEstimate estimate;
+        const size_t stop_count = catalogue.GetStopCount();
+        // A wait edge per stop and a bus edge per ordered pair of stops a bus passes
+        estimate.vertex_count = stop_count * 2;
+        estimate.edge_count = stop_count;
+        for (const auto& [name, bus] : catalogue.GetSortedBuses()) {
+            const size_t n = bus->stops.size();
+            const size_t pairs = n > 0 ? n * (n - 1) / 2 : 0;
+            estimate.edge_count += bus->is_circular ? pairs : pairs * 2;
+        }
+
+        // Edge names are short enough to need no heap; incidence lists grow one by one too,
+        // about a third of their capacity is left unused
+        estimate.graph_bytes = memory::GrownCapacity(estimate.edge_count) * sizeof(graph::Edge<double>)
+            + estimate.vertex_count * sizeof(std::vector<graph::EdgeId>)
+            + estimate.edge_count * sizeof(graph::EdgeId) * 3 / 2
+            + memory::GrownCapacity(estimate.edge_count) * sizeof(BusRide)
+            + stop_count * (sizeof(void*) + sizeof(decltype(stop_vertex_ids_)::value_type) + sizeof(size_t))
+            + memory::GrownCapacity(stop_count) * sizeof(void*);
+        // Exact, the table is allocated in full up front
+        estimate.route_table_bytes = estimate.vertex_count * sizeof(std::vector<std::optional<RouteTableEntry>>)
+            + estimate.vertex_count * estimate.vertex_count * sizeof(std::optional<RouteTableEntry>);
+        return estimate;
+    }
+
+    void CheckRouterMemory(const Router& settings, const TransportCatalogue& catalogue) {
+        const RoutingPlan plan = settings.Plan(catalogue);
+        const std::optional<size_t> budget = settings.GetMemoryBudget();
+        if (budget && plan.GetMemoryUsage() > *budget) {
+            std::ostringstream message;
+            message << "Routing " << plan.memory.vertex_count << " vertices and " << plan.memory.edge_count
+                << " edges needs about " << (plan.GetMemoryUsage() >> 20) << " MB, over the memory budget of "
+                << (*budget >> 20) << " MB";
+            throw std::length_error(message.str());
+        }
+    }
+
+    const graph::DirectedWeightedGraph<double>& Router::BuildGraph(const TransportCatalogue& catalogue) {
+        {
+            instrumentation::Span span("Router.BuildGraph");
+            router_.reset();
+            dijkstra_router_.reset();
+            const auto& stops_map = catalogue.GetSortedStops();
+            const auto& buses_map = catalogue.GetSortedBuses();
+            graph::DirectedWeightedGraph<double> transport_graph(stops_map.size() * 2);
+            stop_vertex_ids_.clear();
+            edge_rides_.clear();
+
+            AddStopsToGraph(stops_map, transport_graph);
+            AddBusesToGraph(buses_map, transport_graph, catalogue);
+
+            graph_ = std::move(transport_graph);
+        }
+        instrumentation::AddCount("graph.vertices", graph_.GetVertexCount());
+        instrumentation::AddCount("graph.edges", graph_.GetEdgeCount());
+        if (instrumentation::IsEnabled()) {
+            instrumentation::RecordMemoryUsage("router.graph", GetGraphMemoryUsage(graph_)
+                + memory::VectorBytes(edge_rides_) + memory::HashMapBytes(stop_vertex_ids_));
+        }
         return graph_;
     }
 
@@ -42,6 +217,7 @@ namespace transport {
                 vertex_id,
                 static_cast<double>(bus_wait_time_)
                 });
+            edge_rides_.emplace_back();
 
             vertex_id++;
         }
@@ -54,15 +230,13 @@ namespace transport {
 
             for (size_t i = 0; i < stops_count; ++i) {
                 for (size_t j = i + 1; j < stops_count; ++j) {
-                    const Stop* stop_from = stops[i];
-                    const Stop* stop_to = stops[j];
                     double dist_sum = CalculateDistanceBetweenStops(catalogue, stops, i, j);
                     double dist_sum_inverse = CalculateDistanceBetweenStopsInverse(catalogue, stops, i, j);
 
-                    AddBusRouteToGraph(bus_info, transport_graph, stop_from, stop_to, dist_sum, j - i);
+                    AddBusRouteToGraph(bus_info, transport_graph, i, j, dist_sum);
 
                     if (!bus_info->is_circular) {
-                        AddBusRouteToGraph(bus_info, transport_graph, stop_to, stop_from, dist_sum_inverse, j - i);
+                        AddBusRouteToGraph(bus_info, transport_graph, j, i, dist_sum_inverse);
                     }
                 }
             }
@@ -85,23 +259,31 @@ namespace transport {
         return distance / (bus_velocity_ * (100.0 / 6.0));
     }
 
-    void Router::AddBusRouteToGraph(const BusRoute* bus_info, graph::DirectedWeightedGraph<double>& transport_graph, const Stop* stop_from, const Stop* stop_to, double distance, size_t stop_count) {
+    void Router::AddBusRouteToGraph(const BusRoute* bus_info, graph::DirectedWeightedGraph<double>& transport_graph, size_t from_index, size_t to_index, double distance) {
         transport_graph.AddEdge({
             bus_info->name,
-            stop_count,
-            stop_vertex_ids_.at(stop_from->name) + 1,
-            stop_vertex_ids_.at(stop_to->name),
+            from_index < to_index ? to_index - from_index : from_index - to_index,
+            stop_vertex_ids_.at(bus_info->stops[from_index]->name) + 1,
+            stop_vertex_ids_.at(bus_info->stops[to_index]->name),
             distance
             });
+        edge_rides_.push_back({ bus_info, from_index, to_index });
+    }
+
+    const std::optional<Route> Router::FindRoute(const Stop* stop_from, const Stop* stop_to) const {
+        return FindRoute(stop_from->name, stop_to->name);
     }
 
     const std::optional<Route> Router::FindRoute(const std::string_view stop_from, const std::string_view stop_to) const {
-        auto route_info = router_->BuildRoute(stop_vertex_ids_.at(std::string(stop_from)), stop_vertex_ids_.at(std::string(stop_to)));
+        const graph::VertexId from = stop_vertex_ids_.at(stop_from);
+        const graph::VertexId to = stop_vertex_ids_.at(stop_to);
+        auto route_info = router_ ? router_->BuildRoute(from, to) : dijkstra_router_->BuildRoute(from, to);
 
         if (!route_info) {
             return std::nullopt;
         }
 
+        instrumentation::AddCount("route.edges", route_info->edges.size());
         Route route;
         route.total_time = 0.0;
 
@@ -122,9 +304,17 @@ namespace transport {
                 item.type = "Bus";
                 item.bus_name = edge.name;
                 item.span_count = static_cast<int>(edge.quality);
+
+                const BusRide& ride = edge_rides_[edge_id];
+                item.bus = ride.bus;
+                item.stops.reserve(item.span_count + 1);
+                for (size_t i = ride.from_index; i != ride.to_index; ride.from_index < ride.to_index ? ++i : --i) {
+                    item.stops.push_back(ride.bus->stops[i]);
+                }
+                item.stops.push_back(ride.bus->stops[ride.to_index]);
             }
 
-            route.items.push_back(item);
+            route.items.push_back(std::move(item));
             route.total_time += edge.weight;
         }
 
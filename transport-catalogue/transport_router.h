@@ -1,9 +1,11 @@
 #pragma once
 
+#include "dijkstra_router.h"
 #include "router.h"
 #include "transport_catalogue.h"
 
 #include <memory>
+#include <optional>
 
 namespace transport {
 
@@ -13,6 +15,9 @@ namespace transport {
         std::string type;
         std::string bus_name;
         int span_count;
+        // Bus items only: the bus and the stops it passes, boarding and leaving stops included
+        const BusRoute* bus = nullptr;
+        std::vector<const Stop*> stops;
     };
 
     struct Route {
@@ -20,29 +25,101 @@ namespace transport {
         std::vector<RouteItem> items;
     };
 
+    // Size of the routing graph and the all-pairs route table, predicted from stop and bus counts
+    struct RouterMemoryEstimate {
+        size_t vertex_count = 0;
+        size_t edge_count = 0;
+        size_t graph_bytes = 0;
+        size_t route_table_bytes = 0;
+
+        size_t GetTotal() const {
+            return graph_bytes + route_table_bytes;
+        }
+    };
+
+    enum class RoutingStrategy {
+        // ALL_PAIRS unless it is over the memory budget, DIJKSTRA then
+        AUTO,
+        // Picked by the estimated costs below. Equally fast routes may be chosen differently
+        // by the two, and total times may differ in the last digit
+        FASTEST,
+        // Every route precomputed into a table quadratic in the stop count, queries are lookups
+        ALL_PAIRS,
+        // A shortest path search per query, nothing precomputed
+        DIJKSTRA
+    };
+
+    struct RoutingPlan {
+        RoutingStrategy strategy = RoutingStrategy::ALL_PAIRS;
+        RouterMemoryEstimate memory;
+        // Route queries the costs are computed for, none if the count is unknown
+        std::optional<size_t> route_query_count;
+        double all_pairs_ms = 0.0;
+        double dijkstra_ms = 0.0;
+
+        // Bytes of the chosen strategy
+        size_t GetMemoryUsage() const;
+    };
+
     class Router {
     public:
         Router() = default;
         Router(int bus_wait_time, double bus_velocity);
+        // Builds the graph and the routing strategy of Plan
         Router(const Router& settings, const TransportCatalogue& catalogue);
 
+        // Strategy overriding AUTO, set by "strategy" of routing settings
+        void SetStrategy(RoutingStrategy strategy);
+        // Route and RouteMap requests expected, used by FASTEST; unknown counts, e.g. for a server,
+        // are assumed to be many, so the precompute pays off
+        void SetRouteQueryCount(size_t count);
+        // AUTO does not pick strategies needing more bytes
+        void SetMemoryBudget(size_t bytes);
+        std::optional<size_t> GetMemoryBudget() const;
+
+        // The strategy and its estimated time and memory for the catalogue
+        RoutingPlan Plan(const TransportCatalogue& catalogue) const;
+
+        // Builds the graph only; routes are found by routers made with the catalogue constructor
         const graph::DirectedWeightedGraph<double>& BuildGraph(const TransportCatalogue& catalogue);
         const std::optional<Route> FindRoute(const std::string_view stop_from, const std::string_view stop_to) const;
+        const std::optional<Route> FindRoute(const Stop* stop_from, const Stop* stop_to) const;
         const graph::DirectedWeightedGraph<double>& GetGraph() const;
 
+        static RouterMemoryEstimate EstimateMemoryUsage(const TransportCatalogue& catalogue);
+
     private:
         void AddStopsToGraph(const std::map<std::string_view, const Stop*>& stops_map, graph::DirectedWeightedGraph<double>& transport_graph);
         void AddBusesToGraph(const std::map<std::string_view, const BusRoute*>& buses_map, graph::DirectedWeightedGraph<double>& transport_graph, const TransportCatalogue& catalogue);
         double CalculateDistanceBetweenStops(const TransportCatalogue& catalogue, const std::vector<Stop*>& stops, size_t from_index, size_t to_index);
         double CalculateDistanceBetweenStopsInverse(const TransportCatalogue& catalogue, const std::vector<Stop*>& stops, size_t from_index, size_t to_index);
-        void AddBusRouteToGraph(const BusRoute* bus_info, graph::DirectedWeightedGraph<double>& transport_graph, const Stop* stop_from, const Stop* stop_to, double distance, size_t stop_count);
+        void AddBusRouteToGraph(const BusRoute* bus_info, graph::DirectedWeightedGraph<double>& transport_graph, size_t from_index, size_t to_index, double distance);
+
+        // Part of a bus route covered by a bus edge, indices into BusRoute::stops.
+        // from_index is greater than to_index when the bus goes back along a linear route
+        struct BusRide {
+            const BusRoute* bus = nullptr;
+            size_t from_index = 0;
+            size_t to_index = 0;
+        };
 
         int bus_wait_time_ = 0;
         double bus_velocity_ = 0.0;
+        RoutingStrategy strategy_ = RoutingStrategy::AUTO;
+        std::optional<size_t> route_query_count_;
+        std::optional<size_t> memory_budget_;
 
         graph::DirectedWeightedGraph<double> graph_;
-        std::unordered_map<std::string, graph::VertexId> stop_vertex_ids_;
+        std::unordered_map<std::string_view, graph::VertexId> stop_vertex_ids_;
+        // Indexed by edge id, wait edges have no bus
+        std::vector<BusRide> edge_rides_;
+        // One of them is built, as planned
         std::unique_ptr<graph::Router<double>> router_;
+        std::unique_ptr<graph::DijkstraRouter<double>> dijkstra_router_;
     };
 
+    // Throws std::length_error if the planned router of the catalogue needs more than the
+    // memory budget of the settings, i.e. even the graph does not fit or ALL_PAIRS was forced
+    void CheckRouterMemory(const Router& settings, const TransportCatalogue& catalogue);
+
 } // namespace transport 
\ No newline at end of file